@@ -0,0 +1,43 @@
+#ifndef AOC_H
+#define AOC_H
+
+/*
+ * Library entry points for the C days, for runner.c.
+ *
+ * Each solver reads one puzzle input and writes one part's answer into
+ * answer as a decimal string, without printing or asserting anything, so
+ * several can run side by side on different threads. They return false if
+ * the input can't be read or has no answer.
+ *
+ * Loaders on the way there say what went wrong through aoc_warn and
+ * aoc_perror, which print in a standalone day and keep quiet in a library
+ * build, so the runner's table stays clean.
+ *
+ * Building a day with -DAOC_LIBRARY leaves out its tests, benchmarks and
+ * main, so all of them can be linked into one program:
+ *
+ *   gcc -O2 -pthread -DAOC_LIBRARY -o runner runner.c day09.c day10.c \
+ *       day11.c day12.c day13.c
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef AOC_LIBRARY
+#define aoc_warn(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#define aoc_perror(what) ((void) (what))
+#else
+#define aoc_warn(...) printf(__VA_ARGS__)
+#define aoc_perror(what) perror(what)
+#endif
+
+typedef bool (*aoc_solver_t)(int part, const char *path, char *answer, size_t answer_size);
+
+bool day09_solve(int part, const char *path, char *answer, size_t answer_size);
+bool day10_solve(int part, const char *path, char *answer, size_t answer_size);
+bool day11_solve(int part, const char *path, char *answer, size_t answer_size);
+bool day12_solve(int part, const char *path, char *answer, size_t answer_size);
+bool day13_solve(int part, const char *path, char *answer, size_t answer_size);
+
+#endif
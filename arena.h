@@ -0,0 +1,133 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * Per-run arena allocator.
+ *
+ * A run allocates everything it needs from one arena and frees it all at
+ * once at the end, so nothing leaks and nothing needs a matching free. A
+ * long-lived caller can instead arena_reset between runs: the chunks are
+ * kept, so once the arena has grown to a run's peak, later runs make no
+ * allocator calls at all.
+ *
+ * Running out of memory is fatal: callers never see NULL, so there's nothing
+ * to check at each of their allocations.
+ *
+ * Header-only and static inline, like input.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;
+  size_t used;
+  _Alignas(16) char data[];
+} arena_chunk_t;
+
+typedef struct arena {
+  arena_chunk_t *head;
+  arena_chunk_t *current;
+  size_t chunk_size;
+  size_t in_use;    // Bytes handed out since the last reset.
+  size_t peak;      // Most ever in use at once.
+  size_t reserved;  // Bytes held in chunks.
+} arena_t;
+
+static inline void arena_init(arena_t *arena, size_t chunk_size) {
+  arena->head = NULL;
+  arena->current = NULL;
+  arena->chunk_size = chunk_size ? chunk_size : 64 * 1024;
+  arena->in_use = 0;
+  arena->peak = 0;
+  arena->reserved = 0;
+}
+
+static inline void arena_out_of_memory(size_t size) {
+  printf("woe! arena can't get %zu bytes\n", size);
+  exit(-1);
+}
+
+/**
+ * 16-byte aligned, uninitialized, and good until the next reset or free.
+ */
+static inline void* arena_alloc(arena_t *arena, size_t size) {
+  if (size > SIZE_MAX - sizeof(arena_chunk_t) - 15) {
+    arena_out_of_memory(size);
+  }
+  size = (size + 15) & ~(size_t) 15;
+
+  // Try the current chunk, then any kept from before the last reset.
+  arena_chunk_t *chunk = arena->current;
+  while (chunk && chunk->used + size > chunk->size) {
+    chunk = chunk->next;
+    if (chunk) {
+      chunk->used = 0;
+    }
+  }
+
+  if (!chunk) {
+    size_t chunk_size = (size > arena->chunk_size) ? size : arena->chunk_size;
+    chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+    if (!chunk) {
+      arena_out_of_memory(chunk_size);
+    }
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    arena->reserved += chunk_size;
+
+    // New chunks go after the current one, ahead of any kept ones.
+    if (arena->current) {
+      chunk->next = arena->current->next;
+      arena->current->next = chunk;
+    } else {
+      chunk->next = arena->head;
+      arena->head = chunk;
+    }
+  }
+
+  arena->current = chunk;
+  void *p = chunk->data + chunk->used;
+  chunk->used += size;
+
+  arena->in_use += size;
+  if (arena->in_use > arena->peak) {
+    arena->peak = arena->in_use;
+  }
+  return p;
+}
+
+static inline void* arena_calloc(arena_t *arena, size_t n, size_t size) {
+  if (size && n > SIZE_MAX / size) {
+    arena_out_of_memory(SIZE_MAX);
+  }
+  void *p = arena_alloc(arena, n * size);
+  return memset(p, 0, n * size);
+}
+
+/**
+ * Forget everything allocated, but keep the memory for next time.
+ */
+static inline void arena_reset(arena_t *arena) {
+  arena->current = arena->head;
+  if (arena->head) {
+    arena->head->used = 0;
+  }
+  arena->in_use = 0;
+}
+
+static inline void arena_free(arena_t *arena) {
+  arena_chunk_t *chunk = arena->head;
+  while (chunk) {
+    arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena_init(arena, arena->chunk_size);
+}
+
+#endif
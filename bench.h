@@ -0,0 +1,130 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Benchmark harness shared by the C days.
+ *
+ * Each day registers its hot kernels: a setup that builds a seeded synthetic
+ * input of a given size, and a run that does one timed call. Running a day
+ * with --bench times every kernel at sizes 10^3, 10^4, ... and prints one
+ * JSON object per kernel and size, so results can be appended to a file and
+ * compared across versions. peak_rss_kb is the process's high-water mark
+ * so far, so read it in order of increasing size. A kernel with an annotate
+ * hook can add fields of its own to the end of each object.
+ *
+ *   ./day09 --bench [max exponent, default 6] [seed, default 2020]
+ *
+ * Header-only and static inline, like input.h.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+typedef struct bench_kernel {
+  const char *day;
+  const char *name;
+  int max_exponent;     // Largest 10^k input that fits in a few GB.
+  void* (*setup)(long size, uint64_t seed);
+  void (*run)(void *state);
+  void (*teardown)(void *state);
+  // Optional: write extra JSON fields (", \"key\": value ...") once the
+  // runs are done.
+  void (*annotate)(void *state, char *out, size_t size);
+} bench_kernel_t;
+
+/**
+ * splitmix64: small, fast, and the same sequence everywhere for a seed.
+ */
+static inline uint64_t bench_random(uint64_t *seed) {
+  uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static inline long bench_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static inline int bench_cmp_long(const void *e1, const void *e2) {
+  long a = *((const long*) e1);
+  long b = *((const long*) e2);
+  return (a > b) - (a < b);
+}
+
+static inline long bench_percentile(const long *sorted, int n, double p) {
+  int i = (int) (p * (n - 1) + 0.5);
+  return sorted[i];
+}
+
+/**
+ * Time one kernel at one size and print the result as a line of JSON.
+ */
+static inline void bench_one(const bench_kernel_t *kernel, long size, uint64_t seed) {
+  const int max_reps = 100;
+  const long budget_ns = 200000000L;
+  long latencies[100];
+
+  void *state = kernel->setup(size, seed);
+
+  // At least five runs; more while they're cheap.
+  int reps = 0;
+  long total_ns = 0;
+  while (reps < max_reps && (reps < 5 || total_ns < budget_ns)) {
+    long start = bench_now_ns();
+    kernel->run(state);
+    latencies[reps] = bench_now_ns() - start;
+    total_ns += latencies[reps++];
+  }
+
+  char extra[512] = "";
+  if (kernel->annotate) {
+    kernel->annotate(state, extra, sizeof(extra));
+  }
+  kernel->teardown(state);
+
+  qsort(latencies, reps, sizeof(long), bench_cmp_long);
+  long p50 = bench_percentile(latencies, reps, 0.50);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("{\"day\": \"%s\", \"kernel\": \"%s\", \"size\": %ld, \"seed\": %lu, "
+         "\"reps\": %d, \"items_per_sec\": %.1f, "
+         "\"latency_ns\": {\"min\": %ld, \"p50\": %ld, \"p90\": %ld, \"p99\": %ld, \"max\": %ld}, "
+         "\"peak_rss_kb\": %ld%s}\n",
+         kernel->day, kernel->name, size, (unsigned long) seed,
+         reps, p50 > 0 ? size * 1e9 / p50 : 0.0,
+         latencies[0], p50,
+         bench_percentile(latencies, reps, 0.90),
+         bench_percentile(latencies, reps, 0.99),
+         latencies[reps - 1],
+         usage.ru_maxrss, extra);
+  fflush(stdout);
+}
+
+/**
+ * Entry point for --bench. argv[2] is the largest exponent, argv[3] the seed.
+ */
+static inline int bench_main(int argc, char **argv,
+                             const bench_kernel_t *kernels, int n_kernels) {
+  int max_exponent = (argc > 2) ? atoi(argv[2]) : 6;
+  uint64_t seed = (argc > 3) ? strtoull(argv[3], NULL, 10) : 2020;
+
+  for (int k = 0; k < n_kernels; ++k) {
+    long size = 1000;
+    for (int e = 3; e <= max_exponent && e <= kernels[k].max_exponent; ++e) {
+      bench_one(&kernels[k], size, seed);
+      size *= 10;
+    }
+  }
+  return 0;
+}
+
+#endif
@@ -2,19 +2,30 @@
 #include <stdio.h>
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "bench.h"
+#include "arena.h"
+#include "pool.h"
+#include "aoc.h"
+#include "prof.h"
+#include "narrow.h"
+#include "pipeline.h"
 
 // there are 1001 elements in the longest input
-const int ARR_SIZE = 2000;
+static const int ARR_SIZE = 2000;
 
 /**
  * Read sample data files.
  * Convert them to an array of long values.
  */
 int fileToNumbers(const char *filename, long numbers[]) {
-
-  FILE *fp = fopen(filename, "rb");
-  if (!fp) {
-    perror("fopen");
+  input_t input;
+  if (!input_open(filename, &input)) {
     return -1;
   }
 
@@ -23,35 +34,24 @@ int fileToNumbers(const char *filename, long numbers[]) {
     numbers[i] = -1;
   }
 
-  long acc = 0L;
+  size_t pos = 0;
   int digit = 0;
+  while (digit < ARR_SIZE && input_next_number(&input, &pos, &numbers[digit])) {
+    digit++;
+  }
 
-  for (int i = 0; ; ++i) {
-    char curr = getc(fp);
-
-    if (curr >= '0' && curr <= '9') {
-      // Reading a digit.
-      acc *= 10;
-      acc += curr - '0';
-    } else {
-      // Return length of array when we are done reading.
-      if (curr == EOF) {
-        fclose(fp);
-        return digit;
-      }
-
-      // Done reading a number.
-      numbers[digit++] = acc;
-      acc = 0L;
-    }
+  input_report(&input, filename);
+  input_close(&input);
 
-  }
+  // Return length of array when we are done reading.
+  return digit;
 }
 
 /**
  * Return index of first bad number; -1 if all are ok.
  */
 int firstBadNumber(long numbers[], int num_numbers, int preamble_length) {
+  PROF_SCOPE("firstBadNumber");
   // Bounds checking?
 
   int index = -1;
@@ -63,7 +63,6 @@ int firstBadNumber(long numbers[], int num_numbers, int preamble_length) {
     for (int j = i - preamble_length; j < i - 1; ++j) {
       for (int k = j + 1; k < i; ++k) {
         if (numbers[i] == numbers[j] + numbers[k]) {
-          printf("ok: %ld = %ld + %ld\n", numbers[i], numbers[j], numbers[k]);
           found = i;
           goto found;
         }
@@ -98,7 +97,7 @@ void seriesSummingToTarget(const long numbers[],
   // Iterate through all the numbers until we find the sequence.
   for (int i = 0; i < num_numbers - 1; ++i) {
     max_so_far = numbers[i];
-    for (int end = i + 1; i < num_numbers && max_so_far <= target; ++end) {
+    for (int end = i + 1; end < num_numbers && max_so_far <= target; ++end) {
       max_so_far += numbers[end];
       if (max_so_far == target) {
         endpoints[0] = i;
@@ -137,9 +136,110 @@ long largestInRange(const long numbers[],
   return max_so_far;
 }
 
-long revealFirstBadNumber(const char* filename, int preamble_length) {
-  long *numbers;
-  numbers = (long*) malloc(sizeof(long) * ARR_SIZE);
+/*
+ * The same kernels for numbers stored 16, 32 or 64 bits wide.
+ *
+ * firstBadNumber looks for x[i] - x[j] among the numbers after x[j], a
+ * 16-byte vector at a time: 8 numbers at 16 bits, 4 at 32. The differences
+ * stay in range as long as the numbers were packed with a bit of headroom
+ * (see xmas_narrow). Two numbers to a vector don't pay for the extra work,
+ * so at 64 bits it's the plain kernel.
+ */
+#define DEFINE_XMAS_SCAN(bits)                                                 \
+typedef int##bits##_t xmas_v##bits __attribute__((vector_size(16)));          \
+                                                                               \
+static int firstBadNumber##bits(const int##bits##_t *x, int num_numbers,       \
+                                int preamble_length) {                         \
+  const int lanes = 16 / sizeof(int##bits##_t);                                \
+                                                                               \
+  for (int i = preamble_length; i < num_numbers; ++i) {                        \
+    bool found = false;                                                        \
+    for (int j = i - preamble_length; j < i - 1 && !found; ++j) {              \
+      int##bits##_t want = (int##bits##_t) (x[i] - x[j]);                      \
+      xmas_v##bits wants = want - (xmas_v##bits) { 0 };                        \
+      xmas_v##bits hits = { 0 };                                               \
+      int k = j + 1;                                                           \
+      for (; k + lanes <= i; k += lanes) {                                     \
+        xmas_v##bits v;                                                        \
+        memcpy(&v, &x[k], sizeof(v));                                          \
+        hits |= (xmas_v##bits) (v == wants);                                   \
+      }                                                                        \
+      uint64_t words[2];                                                       \
+      memcpy(words, &hits, sizeof(words));                                     \
+      found = (words[0] | words[1]) != 0;                                      \
+      for (; k < i; ++k) {                                                     \
+        found |= (x[k] == want);                                               \
+      }                                                                        \
+    }                                                                          \
+    if (!found) {                                                              \
+      return i;                                                                \
+    }                                                                          \
+  }                                                                            \
+  return -1;                                                                   \
+}
+
+#define DEFINE_XMAS_SERIES(bits)                                               \
+static int seriesSummingToTarget##bits(const int##bits##_t *x, int num_numbers, \
+                                       long target, int *endpoints) {          \
+  for (int i = 0; i < num_numbers - 1; ++i) {                                  \
+    long sum = x[i];                                                           \
+    for (int end = i + 1; end < num_numbers && sum <= target; ++end) {         \
+      sum += x[end];                                                           \
+      if (sum == target) {                                                     \
+        endpoints[0] = i;                                                      \
+        endpoints[1] = end;                                                    \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  return endpoints[0];                                                         \
+}
+
+DEFINE_XMAS_SCAN(16)
+DEFINE_XMAS_SCAN(32)
+DEFINE_XMAS_SERIES(16)
+DEFINE_XMAS_SERIES(32)
+DEFINE_XMAS_SERIES(64)
+
+static int firstBadNumber64(const int64_t *x, int num_numbers, int preamble_length) {
+  return firstBadNumber((long*) x, num_numbers, preamble_length);
+}
+
+/**
+ * Pack numbers as narrow as they'll go, with one bit to spare for the
+ * differences firstBadNumber takes.
+ */
+void xmas_narrow(narrow_t *out, const long *numbers, int num_numbers, arena_t *arena) {
+  narrow_longs(out, numbers, num_numbers, 1, arena);
+}
+
+int firstBadNumberNarrow(const narrow_t *numbers, int preamble_length) {
+  PROF_SCOPE("firstBadNumberNarrow");
+  return NARROW_DISPATCH(numbers, firstBadNumber, numbers->n, preamble_length);
+}
+
+/**
+ * Same as seriesSummingToTarget, then the weakness: the smallest plus the
+ * largest number in the series. Return -1 if there's no such series.
+ */
+long encryptionWeaknessNarrow(const narrow_t *numbers, long target) {
+  int endpoints[2] = { -1, -1 };
+  NARROW_DISPATCH(numbers, seriesSummingToTarget, numbers->n, target, endpoints);
+  if (endpoints[0] == -1) {
+    return -1;
+  }
+
+  long smallest = LONG_MAX, largest = LONG_MIN;
+  for (int i = endpoints[0]; i <= endpoints[1]; ++i) {
+    long v = narrow_get(numbers, i);
+    smallest = (v < smallest) ? v : smallest;
+    largest = (v > largest) ? v : largest;
+  }
+  return smallest + largest;
+}
+
+long revealFirstBadNumber(const char* filename, int preamble_length, arena_t *arena) {
+  long *numbers = arena_alloc(arena, sizeof(long) * ARR_SIZE);
 
   int num_numbers = fileToNumbers(filename, numbers);
   printf("value: %d numbers; first is %ld, last is %ld\n", num_numbers, numbers[0], numbers[num_numbers-1]);
@@ -159,24 +259,701 @@ long revealFirstBadNumber(const char* filename, int preamble_length) {
   long largest = largestInRange(numbers, endpoints[0], endpoints[1]);
   printf("XXX Encryption Weakness XXX  = %ld + %ld = %ld\n", smallest, largest, smallest + largest);
 
-  free(numbers);
-
   return bad;
 }
 
+/**
+ * Read every number in a file of any length into the arena.
+ *
+ * Return how many were read, or -1 if the file can't be read.
+ */
+int loadNumbers(const char *filename, long **numbers, arena_t *arena) {
+  input_t input;
+  if (!input_open(filename, &input)) {
+    return -1;
+  }
+
+  // Every number takes at least a digit and a separator.
+  long *out = arena_alloc(arena, sizeof(long) * (input.size / 2 + 1));
+  size_t pos = 0;
+  int n = 0;
+  while (input_next_number(&input, &pos, &out[n])) {
+    n++;
+  }
+
+  input_close(&input);
+  *numbers = out;
+  return n;
+}
+
+/**
+ * Find the first bad number in a file of any size without loading all of
+ * it: each chunk is checked while the next one is read (see pipeline.h),
+ * and only the last preamble_length numbers are kept from one to the next.
+ *
+ * Return its index, with its value in *bad; -1 if every number checks out,
+ * or -2 if the file can't be read.
+ */
+long firstBadNumberFile(const char *filename, int preamble_length, bool use_uring,
+                        long *bad, pipeline_stats_t *stats) {
+  pipeline_t pipe;
+  if (!pipeline_open(&pipe, filename, 0, use_uring)) {
+    return -2;
+  }
+
+  // Every number takes at least a digit and a separator.
+  long capacity = preamble_length + (PIPELINE_MAX_LINE + pipe.chunk_size) / 2 + 1;
+  long *window = malloc(sizeof(long) * capacity);
+  long dropped = 0;   // Numbers before window[0].
+  int kept = 0;
+  long index = -1;
+
+  input_t chunk;
+  while (pipeline_next(&pipe, &chunk)) {
+    size_t pos = 0;
+    int n = kept;
+    while (input_next_number(&chunk, &pos, &window[n])) {
+      n++;
+    }
+
+    // The first preamble_length of the window have been checked already,
+    // or are the preamble.
+    int i = firstBadNumber(window, n, preamble_length);
+    if (i != -1) {
+      index = dropped + i;
+      *bad = window[i];
+      break;
+    }
+
+    kept = (n < preamble_length) ? n : preamble_length;
+    memmove(window, window + n - kept, sizeof(long) * kept);
+    dropped += n - kept;
+  }
+
+  if (pipe.failed) {
+    index = -2;
+  }
+  free(window);
+  pipeline_close(&pipe, stats);
+  return index;
+}
+
+/*
+ * Batch mode: validate many independent streams at once.
+ *
+ * A manifest lists one stream per line, as a path and its preamble length.
+ * Streams are handed out by pool.h, so each one is loaded into its worker's
+ * arena and buffers are reused rather than reallocated.
+ */
+typedef struct xmas_job {
+  char path[256];
+  int preamble_length;
+
+  // Results.
+  bool ok;
+  int n_numbers;
+  int width;        // Bits per number it was checked at.
+  int bad_index;    // -1 if every number checks out.
+  long bad;
+  long weakness;    // -1 if no series sums to the bad number.
+} xmas_job_t;
+
+static void run_xmas_job(void *arg, arena_t *arena) {
+  xmas_job_t *job = arg;
+  long *numbers;
+  narrow_t narrow;
+
+  job->n_numbers = loadNumbers(job->path, &numbers, arena);
+  job->ok = (job->n_numbers >= 0);
+  job->bad_index = -1;
+  job->bad = -1;
+  job->weakness = -1;
+  if (!job->ok) {
+    return;
+  }
+
+  xmas_narrow(&narrow, numbers, job->n_numbers, arena);
+  job->width = narrow.width;
+  job->bad_index = firstBadNumberNarrow(&narrow, job->preamble_length);
+  if (job->bad_index == -1) {
+    return;
+  }
+
+  job->bad = numbers[job->bad_index];
+  job->weakness = encryptionWeaknessNarrow(&narrow, job->bad);
+}
+
+/**
+ * Validate every job's stream on n_threads threads. Results are written back
+ * into each job.
+ */
+void validate_streams(xmas_job_t *jobs, int n_jobs, int n_threads) {
+  pool_run(jobs, sizeof(xmas_job_t), n_jobs, n_threads, run_xmas_job);
+}
+
+/**
+ * Read a manifest of "path preamble_length" lines; # starts a comment.
+ *
+ * Return the number of jobs, with *jobs malloced, or -1 (with a message) if
+ * the manifest is missing or a line is bad.
+ */
+int read_manifest(const char *filename, xmas_job_t **jobs) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    perror(filename);
+    return -1;
+  }
+
+  int n_jobs = 0;
+  int capacity = 64;
+  *jobs = malloc(sizeof(xmas_job_t) * capacity);
+
+  char line[512];
+  int line_no = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    line_no++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+
+    char path[256];
+    int preamble_length;
+    int fields = sscanf(line, "%255s %d", path, &preamble_length);
+    if (fields == EOF) {
+      continue;
+    }
+    if (fields != 2 || preamble_length < 2) {
+      printf("woe! bad stream at %s:%d\n", filename, line_no);
+      fclose(fp);
+      free(*jobs);
+      *jobs = NULL;
+      return -1;
+    }
+
+    if (n_jobs == capacity) {
+      capacity *= 2;
+      *jobs = realloc(*jobs, sizeof(xmas_job_t) * capacity);
+    }
+    memset(&(*jobs)[n_jobs], 0, sizeof(xmas_job_t));
+    strcpy((*jobs)[n_jobs].path, path);
+    (*jobs)[n_jobs].preamble_length = preamble_length;
+    n_jobs++;
+  }
+
+  fclose(fp);
+  return n_jobs;
+}
+
+/**
+ * One line per stream: path, count, then the bad number's index, the bad
+ * number and the weakness, with - for any that don't exist. Unreadable
+ * streams just say so.
+ */
+void print_stream_result(FILE *fp, const xmas_job_t *job) {
+  if (!job->ok) {
+    fprintf(fp, "%s error\n", job->path);
+  } else if (job->bad_index == -1) {
+    fprintf(fp, "%s %d - - -\n", job->path, job->n_numbers);
+  } else if (job->weakness == -1) {
+    fprintf(fp, "%s %d %d %ld -\n", job->path, job->n_numbers, job->bad_index, job->bad);
+  } else {
+    fprintf(fp, "%s %d %d %ld %ld\n", job->path, job->n_numbers, job->bad_index,
+            job->bad, job->weakness);
+  }
+}
+
+/**
+ * Part 1 is the first number that isn't the sum of two of the 25 before it;
+ * part 2 is the encryption weakness for that number.
+ *
+ * The preamble is always the puzzle's 25, so the 5-number example from the
+ * puzzle text (day09_test_data.txt) can't be solved here; the self-tests in
+ * test() cover it instead. An input with no more than 25 numbers fails,
+ * saying so in a standalone build.
+ */
+bool day09_solve(int part, const char *path, char *answer, size_t answer_size) {
+  PROF_SCOPE("day09_solve");
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  long *numbers;
+  narrow_t narrow;
+  int num_numbers = loadNumbers(path, &numbers, &arena);
+  int index = -1;
+  if (num_numbers > 0 && num_numbers <= 25) {
+    aoc_warn("woe! %s has %d numbers, not more than the 25-number preamble\n", path, num_numbers);
+  } else if (num_numbers > 0) {
+    xmas_narrow(&narrow, numbers, num_numbers, &arena);
+    index = firstBadNumberNarrow(&narrow, 25);
+  }
+  bool ok = (index != -1);
+
+  if (ok && part == 1) {
+    snprintf(answer, answer_size, "%ld", numbers[index]);
+  } else if (ok) {
+    long weakness = encryptionWeaknessNarrow(&narrow, numbers[index]);
+    ok = (weakness != -1);
+    if (ok) {
+      snprintf(answer, answer_size, "%ld", weakness);
+    }
+  }
+
+  arena_free(&arena);
+  return ok;
+}
+
+#ifndef AOC_LIBRARY
+
 void test() {
-  long bad = revealFirstBadNumber("day09_test_data.txt", 5);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  long bad = revealFirstBadNumber("day09_test_data.txt", 5, &arena);
   assert(bad == 127L);
+
+  arena_free(&arena);
 }
 
 void run() {
-  revealFirstBadNumber("day09_data.txt", 25);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  revealFirstBadNumber("day09_data.txt", 25, &arena);
+
+  arena_free(&arena);
+}
+
+void test_batch() {
+  // Every other stream is the example, with its short preamble.
+  char manifest[] = "/tmp/day09_XXXXXX";
+  int fd = mkstemp(manifest);
+  assert(fd >= 0);
+  FILE *fp = fdopen(fd, "w");
+  int n_streams = 1000;
+  fprintf(fp, "# path preamble\n");
+  for (int i = 0; i < n_streams; ++i) {
+    fprintf(fp, (i % 2) ? "day09_test_data.txt 5\n" : "day09_data.txt 25\n");
+  }
+  fprintf(fp, "nope.txt 25\n");
+  fclose(fp);
+
+  xmas_job_t *jobs;
+  int n_jobs = read_manifest(manifest, &jobs);
+  unlink(manifest);
+  assert(n_jobs == n_streams + 1);
+
+  validate_streams(jobs, n_jobs, 8);
+  for (int i = 0; i < n_streams; ++i) {
+    assert(jobs[i].ok);
+    if (i % 2) {
+      assert(jobs[i].n_numbers == 20);
+      assert(jobs[i].bad == 127 && jobs[i].bad_index == 14);
+      assert(jobs[i].weakness == 62);
+    } else {
+      assert(jobs[i].bad == 393911906);
+      assert(jobs[i].weakness == 59341885);
+    }
+  }
+  assert(!jobs[n_streams].ok);
+
+  print_stream_result(stdout, &jobs[0]);
+  print_stream_result(stdout, &jobs[n_streams]);
+  free(jobs);
+}
+
+/**
+ * ./day09 --batch manifest [threads]
+ *
+ * Results go to stdout in manifest order, throughput to stderr.
+ */
+int batch_main(int argc, char **argv) {
+  if (argc < 3) {
+    printf("usage: %s --batch manifest [threads]\n", argv[0]);
+    return 1;
+  }
+  int n_threads = (argc > 3) ? atoi(argv[3]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+  xmas_job_t *jobs;
+  int n_jobs = read_manifest(argv[2], &jobs);
+  if (n_jobs < 0) {
+    return 1;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  validate_streams(jobs, n_jobs, n_threads);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  long n_numbers = 0;
+  int failed = 0;
+  for (int i = 0; i < n_jobs; ++i) {
+    print_stream_result(stdout, &jobs[i]);
+    if (jobs[i].ok) {
+      n_numbers += jobs[i].n_numbers;
+    } else {
+      failed++;
+    }
+  }
+
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%d streams (%d unreadable), %ld numbers on %d threads in %.3fs: "
+                  "%.0f streams/s, %.0f numbers/s\n",
+          n_jobs, failed, n_numbers, n_threads, secs,
+          secs > 0 ? n_jobs / secs : 0.0, secs > 0 ? n_numbers / secs : 0.0);
+
+  free(jobs);
+  return failed ? 1 : 0;
+}
+
+/*
+ * Benchmarks: a stream where every number after the preamble is the sum of
+ * two of the 25 before it, except the very last one.
+ *
+ * Sums of sums grow exponentially, so the stream keeps 1, 0 and -1 somewhere
+ * in every window (each can be rebuilt from the other two before it falls
+ * out) and uses them to walk a number up or down once sums get too big.
+ */
+static void fill_xmas(long *x, long size, uint64_t seed, long too_big, long bad) {
+  for (long i = 0; i < 25; ++i) {
+    x[i] = 2 + bench_random(&seed) % 1000;
+  }
+  long last_one = 3, last_zero = 11, last_minus_one = 19;
+  x[last_one] = 1;
+  x[last_zero] = 0;
+  x[last_minus_one] = -1;
+
+  for (long i = 25; i < size - 1; ++i) {
+    long oldest = i - 25;
+
+    if (last_one == oldest) {
+      x[i] = x[oldest] + x[last_zero];
+    } else if (last_zero == oldest) {
+      x[i] = x[last_one] + x[last_minus_one];
+    } else if (last_minus_one == oldest) {
+      x[i] = x[oldest] + x[last_zero];
+    } else {
+      long j = oldest + bench_random(&seed) % 25;
+      long k = oldest + bench_random(&seed) % 25;
+      if (j == k) {
+        k = (k == i - 1) ? oldest : k + 1;
+      }
+      x[i] = x[j] + x[k];
+      if (x[i] > too_big || x[i] < -too_big) {
+        x[i] = x[j] + ((x[j] > 0) ? -1 : 1);
+      }
+    }
+
+    switch (x[i]) {
+      case 1: last_one = i; break;
+      case 0: last_zero = i; break;
+      case -1: last_minus_one = i; break;
+    }
+  }
+
+  // Nothing in the window sums to this.
+  x[size - 1] = bad;
+}
+
+typedef struct xmas_bench {
+  long *numbers;
+  long size;
+  arena_t arena;
+  narrow_t narrow;
+} xmas_bench_t;
+
+void* setup_xmas(long size, uint64_t seed) {
+  const long too_big = 1000000000000L;
+  xmas_bench_t *bench = malloc(sizeof(xmas_bench_t));
+  bench->numbers = malloc(sizeof(long) * size);
+  bench->size = size;
+  fill_xmas(bench->numbers, size, seed, too_big, 1000 * too_big + 7);
+  arena_init(&bench->arena, 0);
+  return bench;
+}
+
+/*
+ * The narrow kernels all get the same stream, small enough for 16 bits, so
+ * the only difference is how wide it's stored. firstBadNumber/small runs
+ * the plain kernel on it too, as the baseline to measure them against.
+ */
+static void* setup_xmas_width(long size, uint64_t seed, int width) {
+  const long too_big = 4000;
+  xmas_bench_t *bench = malloc(sizeof(xmas_bench_t));
+  bench->numbers = malloc(sizeof(long) * size);
+  bench->size = size;
+  fill_xmas(bench->numbers, size, seed, too_big, 3 * too_big + 7);
+  arena_init(&bench->arena, 0);
+  narrow_pack_longs(&bench->narrow, bench->numbers, (int) size, width, &bench->arena);
+  return bench;
+}
+
+void* setup_xmas16(long size, uint64_t seed) {
+  return setup_xmas_width(size, seed, 16);
+}
+
+void* setup_xmas32(long size, uint64_t seed) {
+  return setup_xmas_width(size, seed, 32);
+}
+
+void* setup_xmas64(long size, uint64_t seed) {
+  return setup_xmas_width(size, seed, 64);
+}
+
+void run_xmas(void *state) {
+  xmas_bench_t *bench = state;
+  int bad = firstBadNumber(bench->numbers, (int) bench->size, 25);
+  assert(bad == bench->size - 1);
+}
+
+void run_xmas_narrow(void *state) {
+  xmas_bench_t *bench = state;
+  int bad = firstBadNumberNarrow(&bench->narrow, 25);
+  assert(bad == bench->size - 1);
 }
 
+void teardown_xmas(void *state) {
+  xmas_bench_t *bench = state;
+  arena_free(&bench->arena);
+  free(bench->numbers);
+  free(bench);
+}
+
+/**
+ * Narrow storage should pick the right width and agree with the plain
+ * kernels at every width that fits.
+ */
+void test_narrow() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  long *numbers;
+  narrow_t narrow;
+  int n = loadNumbers("day09_test_data.txt", &numbers, &arena);
+  xmas_narrow(&narrow, numbers, n, &arena);
+  assert(narrow.width == 16);
+  assert(firstBadNumberNarrow(&narrow, 5) == 14);
+  assert(encryptionWeaknessNarrow(&narrow, 127) == 62);
+
+  n = loadNumbers("day09_data.txt", &numbers, &arena);
+  xmas_narrow(&narrow, numbers, n, &arena);
+  assert(narrow.width == 64);
+  assert(firstBadNumberNarrow(&narrow, 25) == firstBadNumber(numbers, n, 25));
+
+  assert(narrow_width(-16384, 16383, 1) == 16);
+  assert(narrow_width(-16384, 16384, 1) == 32);
+  assert(narrow_width(0, 1L << 40, 1) == 64);
+
+  long size = 10000;
+  long too_bigs[] = { 4000, 100000000, 1000000000000L };
+  int widths[] = { 16, 32, 64 };
+  numbers = arena_alloc(&arena, sizeof(long) * size);
+  for (int t = 0; t < 3; ++t) {
+    fill_xmas(numbers, size, 9 + t, too_bigs[t], 3 * too_bigs[t] + 7);
+    xmas_narrow(&narrow, numbers, (int) size, &arena);
+    assert(narrow.width == widths[t]);
+
+    for (int w = t; w < 3; ++w) {
+      narrow_pack_longs(&narrow, numbers, (int) size, widths[w], &arena);
+      assert(firstBadNumberNarrow(&narrow, 25) == size - 1);
+    }
+    assert(firstBadNumber(numbers, (int) size, 25) == size - 1);
+
+    // Knock one number out so it's no longer a sum.
+    numbers[size / 2] = 3 * too_bigs[t] + 5;
+    narrow_pack_longs(&narrow, numbers, (int) size, widths[t], &arena);
+    assert(firstBadNumberNarrow(&narrow, 25) == firstBadNumber(numbers, (int) size, 25));
+  }
+
+  arena_free(&arena);
+}
+
+/*
+ * Files only hold unsigned numbers, so streams for them stay non-negative:
+ * every eighth number is 0 (0 + 0, with at least three zeros in any
+ * window), and a sum that gets too big is replaced by one of its terms
+ * plus a zero.
+ */
+static void fill_xmas_unsigned(long *x, long size, uint64_t seed, long too_big, long bad) {
+  for (long i = 0; i < size - 1; ++i) {
+    if (i % 8 == 0) {
+      x[i] = 0;
+    } else if (i < 25) {
+      x[i] = 1 + bench_random(&seed) % 1000;
+    } else {
+      long oldest = i - 25;
+      long j = oldest + bench_random(&seed) % 25;
+      long k = oldest + bench_random(&seed) % 25;
+      if (j == k) {
+        k = (k == i - 1) ? oldest : k + 1;
+      }
+      x[i] = x[j] + x[k];
+      if (x[i] > too_big) {
+        x[i] = x[j];
+      }
+    }
+  }
+
+  // Nothing in the window sums to this.
+  x[size - 1] = bad;
+}
+
+static void write_numbers(const char *path, const long *x, long size) {
+  FILE *fp = fopen(path, "w");
+  assert(fp != NULL);
+  for (long i = 0; i < size; ++i) {
+    fprintf(fp, "%ld\n", x[i]);
+  }
+  fclose(fp);
+}
+
+/**
+ * The pipelined check should agree with the loaded one, across many
+ * chunks and on both backends.
+ */
+void test_pipeline() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  long *numbers;
+  int n = loadNumbers("day09_data.txt", &numbers, &arena);
+  int expected = firstBadNumber(numbers, n, 25);
+
+  long size = 500000;
+  long *stream = arena_alloc(&arena, sizeof(long) * size);
+  fill_xmas_unsigned(stream, size, 48, 1000000000000L, 3000000000007L);
+  assert(firstBadNumber(stream, (int) size, 25) == size - 1);
+
+  char path[] = "/tmp/day09_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+
+  for (int uring = 0; uring < 2; ++uring) {
+    long bad = 0;
+    long index;
+    pipeline_stats_t stats;
+    index = firstBadNumberFile("day09_test_data.txt", 5, uring, &bad, NULL);
+    assert(index == 14);
+    assert(bad == 127);
+    index = firstBadNumberFile("day09_data.txt", 25, uring, &bad, NULL);
+    assert(index == expected);
+    assert(bad == numbers[expected]);
+    index = firstBadNumberFile("no_such_file.txt", 25, uring, &bad, NULL);
+    assert(index == -2);
+
+    write_numbers(path, stream, size);
+    index = firstBadNumberFile(path, 25, uring, &bad, &stats);
+    assert(index == size - 1);
+    assert(bad == 3000000000007L);
+    assert(stats.chunks > 1);
+
+    // Bad numbers well past the first chunk, and then none at all.
+    long saved = stream[size / 2];
+    stream[size / 2] = 3000000000005L;
+    write_numbers(path, stream, size);
+    index = firstBadNumberFile(path, 25, uring, &bad, NULL);
+    assert(index == size / 2);
+    stream[size / 2] = saved;
+
+    write_numbers(path, stream, size - 1);
+    index = firstBadNumberFile(path, 25, uring, &bad, NULL);
+    assert(index == -1);
+  }
+
+  unlink(path);
+  arena_free(&arena);
+}
+
+/*
+ * The unsigned stream from a file, read cold through the pipeline on each
+ * backend, with the overlap it got.
+ */
+typedef struct xmas_file_bench {
+  char path[32];
+  long size;
+  bool use_uring;
+  pipeline_stats_t total;
+  int runs;
+} xmas_file_bench_t;
+
+static void* setup_xmas_file(long size, uint64_t seed, bool use_uring) {
+  const long too_big = 1000000000000L;
+  xmas_file_bench_t *bench = calloc(1, sizeof(xmas_file_bench_t));
+  strcpy(bench->path, "/tmp/day09_XXXXXX");
+  close(mkstemp(bench->path));
+  bench->size = size;
+  bench->use_uring = use_uring;
+
+  long *numbers = malloc(sizeof(long) * size);
+  fill_xmas_unsigned(numbers, size, seed, too_big, 3 * too_big + 7);
+  write_numbers(bench->path, numbers, size);
+  free(numbers);
+  return bench;
+}
+
+void* setup_xmas_file_uring(long size, uint64_t seed) {
+  return setup_xmas_file(size, seed, true);
+}
+
+void* setup_xmas_file_thread(long size, uint64_t seed) {
+  return setup_xmas_file(size, seed, false);
+}
+
+void run_xmas_file(void *state) {
+  xmas_file_bench_t *bench = state;
+  long bad;
+  pipeline_stats_t stats;
+  pipeline_drop_cache(bench->path);
+  long index = firstBadNumberFile(bench->path, 25, bench->use_uring, &bad, &stats);
+  assert(index == bench->size - 1);
+  pipeline_stats_add(&bench->total, &stats);
+  bench->runs++;
+}
+
+void annotate_xmas_file(void *state, char *out, size_t size) {
+  xmas_file_bench_t *bench = state;
+  pipeline_annotate(bench->path, &bench->total, bench->runs, out, size);
+}
+
+void teardown_xmas_file(void *state) {
+  xmas_file_bench_t *bench = state;
+  unlink(bench->path);
+  free(bench);
+}
+
+// 10^8 numbers is 800 MB as longs, twice that once packed; 10^9 won't fit.
+const bench_kernel_t kernels[] = {
+  { "day09", "firstBadNumber", 8, setup_xmas, run_xmas, teardown_xmas, NULL },
+  { "day09", "firstBadNumber/small", 8, setup_xmas16, run_xmas, teardown_xmas, NULL },
+  { "day09", "firstBadNumberNarrow/16", 8, setup_xmas16, run_xmas_narrow, teardown_xmas, NULL },
+  { "day09", "firstBadNumberNarrow/32", 8, setup_xmas32, run_xmas_narrow, teardown_xmas, NULL },
+  { "day09", "firstBadNumberNarrow/64", 8, setup_xmas64, run_xmas_narrow, teardown_xmas, NULL },
+  { "day09", "firstBadNumberFile/io_uring", 7, setup_xmas_file_uring, run_xmas_file,
+    teardown_xmas_file, annotate_xmas_file },
+  { "day09", "firstBadNumberFile/thread", 7, setup_xmas_file_thread, run_xmas_file,
+    teardown_xmas_file, annotate_xmas_file },
+};
+
 int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return bench_main(argc, argv, kernels, sizeof(kernels) / sizeof(kernels[0]));
+  }
+  if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+    return batch_main(argc, argv);
+  }
+
   test();
 
   run();
 
+  test_narrow();
+
+  test_batch();
+
+  test_pipeline();
+
   return 0;
 }
+
+#endif
@@ -3,10 +3,15 @@
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
 
-int ARR_SIZE = 2000;
+#include "input.h"
+#include "bench.h"
+#include "arena.h"
+#include "aoc.h"
+#include "prof.h"
 
-int cmp(const void *e1, const void *e2) {
+static int cmp(const void *e1, const void *e2) {
   int a = *((int*) e1);
   int b = *((int*) e2);
 
@@ -15,6 +20,26 @@ int cmp(const void *e1, const void *e2) {
   return 0;
 }
 
+/**
+ * Parse up to joltages_size - 1 joltages after the outlet's 0, and sort them.
+ */
+static int parseJoltages(const input_t *input, int *joltages, size_t joltages_size) {
+  int i = 0;
+  size_t pos = 0;
+  long joltage;
+
+  // joltage of the device we're connecting to.
+  joltages[i++] = 0;
+
+  while (i < (int) joltages_size && input_next_number(input, &pos, &joltage)) {
+    joltages[i++] = (int) joltage;
+  }
+
+  // Sort in place
+  qsort(joltages, i, sizeof(*joltages), cmp);
+  return i;
+}
+
 /**
  * Read the joltages file into a sorted array of joltages.
  *
@@ -23,35 +48,37 @@ int cmp(const void *e1, const void *e2) {
 int readJoltages(const char* filename,
                   int *joltages,
                   size_t joltages_size) {
-  FILE *fp = fopen(filename, "r");
-  if (!fp) {
-    perror("fopen");
+  input_t input;
+  if (!input_open(filename, &input)) {
     return 0;
   }
 
   memset(joltages, -1, sizeof(int) * joltages_size);
+  int i = parseJoltages(&input, joltages, joltages_size);
 
-  int acc = 0;
-  int i = 0;
-  char c;
-
-  // joltage of the device we're connecting to.
-  joltages[i++] = 0;
+  input_report(&input, filename);
+  input_close(&input);
+  return i;
+}
 
-  while ((c = getc(fp)) != EOF) {
-    if (c >= '0' && c <= '9') {
-      acc *= 10;
-      acc += c - '0';
-    } else {
-      joltages[i++] = acc;
-      acc = 0;
-    }
+/**
+ * Read every joltage in the file, however many, into a sorted array from
+ * arena, the outlet's 0 first.
+ *
+ * Return number of elements read, or 0 if the file can't be read.
+ */
+int loadJoltages(const char *filename, int **joltages, arena_t *arena) {
+  input_t input;
+  if (!input_open(filename, &input)) {
+    return 0;
   }
 
-  // Sort in place
-  qsort(joltages, i, sizeof(*joltages), cmp);
+  // Every joltage takes at least a digit and a separator, plus the outlet.
+  size_t size = input.size / 2 + 2;
+  *joltages = arena_alloc(arena, sizeof(int) * size);
+  int i = parseJoltages(&input, *joltages, size);
 
-  fclose(fp);
+  input_close(&input);
   return i;
 }
 
@@ -130,10 +157,165 @@ long validPermutationsMemoized(const int* joltages,
   return sum;
 }
 
+/*
+ * Run-length counting.
+ *
+ * Adapter lists come in long runs of consecutive joltages. Walking up one
+ * jolt at a time, the number of chains ending at each of the last three
+ * joltages (v, v - 1, v - 2) moves on by one of two fixed linear maps:
+ *
+ *   v + 1 is an adapter:   (a, b, c) -> (a + b + c, a, b)    RUN_STEP
+ *   v + 1 isn't:           (a, b, c) -> (0, a, b)            GAP_STEP
+ *
+ * so a run of L adapters is RUN_STEP^L. With RUN_STEP^1, ^2, ^4, ... worked
+ * out once, that's one matrix-vector product per set bit of L: O(log L) per
+ * run, no matter how many joltages it spans.
+ *
+ * Counts are kept mod 2^64: exact whenever the real count fits in 64 bits,
+ * as the puzzle's does, and a consistent fingerprint when it doesn't.
+ */
+typedef struct joltage_run {
+  long gap;      // From the joltage before (or the outlet) to our first.
+  long length;   // Consecutive joltages, one jolt apart.
+} joltage_run_t;
+
+typedef struct mat3 {
+  uint64_t m[3][3];
+} mat3_t;
+
+static const mat3_t RUN_STEP = { { { 1, 1, 1 }, { 1, 0, 0 }, { 0, 1, 0 } } };
+
+static mat3_t mat3_mul(const mat3_t *a, const mat3_t *b) {
+  mat3_t c;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      c.m[i][j] = a->m[i][0] * b->m[0][j]
+                + a->m[i][1] * b->m[1][j]
+                + a->m[i][2] * b->m[2][j];
+    }
+  }
+  return c;
+}
+
+static void mat3_apply(const mat3_t *a, uint64_t v[3]) {
+  uint64_t out[3];
+  for (int i = 0; i < 3; ++i) {
+    out[i] = a->m[i][0] * v[0] + a->m[i][1] * v[1] + a->m[i][2] * v[2];
+  }
+  memcpy(v, out, sizeof(out));
+}
+
+/**
+ * Compress a sorted list of joltages, outlet first, into runs.
+ *
+ * Return the number of runs, or -1 if any joltage is repeated.
+ */
+int compressJoltages(const int* joltages, int joltages_size, joltage_run_t *runs) {
+  int n_runs = 0;
+
+  for (int i = 1; i < joltages_size; ++i) {
+    long gap = joltages[i] - joltages[i - 1];
+    if (gap <= 0) {
+      return -1;
+    }
+    if (gap == 1 && n_runs > 0) {
+      runs[n_runs - 1].length++;
+    } else {
+      runs[n_runs].gap = gap;
+      runs[n_runs].length = 1;
+      n_runs++;
+    }
+  }
+
+  return n_runs;
+}
+
+/**
+ * Return the number of valid charger chains through runs of adapters, mod
+ * 2^64. Our device is always 3 jolts above the last one, so it adds nothing.
+ */
+uint64_t validPermutationsRuns(const joltage_run_t *runs, int n_runs) {
+  PROF_SCOPE("validPermutationsRuns");
+  long longest = 0;
+  for (int r = 0; r < n_runs; ++r) {
+    if (runs[r].gap > 3) {
+      return 0;
+    }
+    if (runs[r].length > longest) {
+      longest = runs[r].length;
+    }
+  }
+
+  // powers[k] is RUN_STEP^(2^k).
+  mat3_t powers[64];
+  int n_powers = 1;
+  powers[0] = RUN_STEP;
+  while ((longest >> n_powers) > 0) {
+    powers[n_powers] = mat3_mul(&powers[n_powers - 1], &powers[n_powers - 1]);
+    n_powers++;
+  }
+
+  // Chains ending at the outlet, and the two joltages below it.
+  uint64_t chains[3] = { 1, 0, 0 };
+
+  for (int r = 0; r < n_runs; ++r) {
+    // GAP_STEP for each missing joltage.
+    for (long g = 1; g < runs[r].gap; ++g) {
+      chains[2] = chains[1];
+      chains[1] = chains[0];
+      chains[0] = 0;
+    }
+
+    for (long length = runs[r].length, k = 0; length > 0; length >>= 1, ++k) {
+      if (length & 1) {
+        mat3_apply(&powers[k], chains);
+      }
+    }
+  }
+
+  return chains[0];
+}
+
+/**
+ * Part 1 is the 1-jolt differences times the 3-jolt differences; part 2 is
+ * the number of distinct adapter chains.
+ */
+bool day10_solve(int part, const char *path, char *answer, size_t answer_size) {
+  PROF_SCOPE("day10_solve");
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  int *joltages;
+  int num_joltages = loadJoltages(path, &joltages, &arena);
+  bool ok = (num_joltages > 1);
+
+  if (ok && part == 1) {
+    int differences[4];
+    findDifferences(joltages, num_joltages, differences, 4);
+    snprintf(answer, answer_size, "%d", differences[1] * differences[3]);
+  } else if (ok) {
+    joltage_run_t *runs = arena_alloc(&arena, sizeof(joltage_run_t) * num_joltages);
+    int n_runs = compressJoltages(joltages, num_joltages, runs);
+    ok = (n_runs >= 0);
+    if (ok) {
+      snprintf(answer, answer_size, "%lu",
+               (unsigned long) validPermutationsRuns(runs, n_runs));
+    }
+  }
+
+  arena_free(&arena);
+  return ok;
+}
+
+#ifndef AOC_LIBRARY
+
 void test() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
   int test_arr_size = 50;
   int num_joltages;
-  int *joltages = malloc(sizeof(int) * test_arr_size);
+  int *joltages = arena_alloc(&arena, sizeof(int) * test_arr_size);
 
   num_joltages = readJoltages("day10_test_data.txt", joltages, test_arr_size);
 
@@ -144,7 +326,7 @@ void test() {
 
   // Find the differences
   int differences_size = 4;
-  int *differences = malloc(sizeof(int) * differences_size);
+  int *differences = arena_alloc(&arena, sizeof(int) * differences_size);
   findDifferences(joltages, num_joltages, differences, differences_size);
 
   for (int i = 1; i < differences_size; ++i) {
@@ -154,8 +336,7 @@ void test() {
   assert(differences[1] == 22);
   assert(differences[3] == 10);
 
-  free(joltages);
-  free(differences);
+  arena_free(&arena);
 }
 
 /**
@@ -165,9 +346,12 @@ void test() {
  * 1-jolt differences multiplied by the number of 3-jolt differences?
  */
 void run() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
   int test_arr_size = 400;
   int num_joltages;
-  int *joltages = malloc(sizeof(int) * test_arr_size);
+  int *joltages = arena_alloc(&arena, sizeof(int) * test_arr_size);
 
   num_joltages = readJoltages("day10_data.txt", joltages, test_arr_size);
 
@@ -178,7 +362,7 @@ void run() {
 
   // Find the differences
   int differences_size = 4;
-  int *differences = malloc(sizeof(int) * differences_size);
+  int *differences = arena_alloc(&arena, sizeof(int) * differences_size);
   findDifferences(joltages, num_joltages, differences, differences_size);
 
   for (int i = 1; i < differences_size; ++i) {
@@ -186,15 +370,20 @@ void run() {
   }
 
   printf("1-jolt diffs x 3-jolt diffs = %d\n", differences[1] * differences[3]);
+
+  arena_free(&arena);
 }
 
 /**
  * There should be 19208 distinct arrangements of plugs in test_data.
  */
 void test2_dumb_recursion() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
   int test_arr_size = 50;
   int num_joltages;
-  int *joltages = malloc(sizeof(int) * test_arr_size);
+  int *joltages = arena_alloc(&arena, sizeof(int) * test_arr_size);
 
   num_joltages = readJoltages("day10_test_data.txt", joltages, test_arr_size);
 
@@ -206,12 +395,17 @@ void test2_dumb_recursion() {
   printf("Test data: found %d valid chains\n", p);
 
   assert(p == 19208);
+
+  arena_free(&arena);
 }
 
 void test2_memoized() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
   int test_arr_size = 50;
   int num_joltages;
-  int *joltages = malloc(sizeof(int) * test_arr_size);
+  int *joltages = arena_alloc(&arena, sizeof(int) * test_arr_size);
 
   num_joltages = readJoltages("day10_test_data.txt", joltages, test_arr_size);
 
@@ -219,19 +413,103 @@ void test2_memoized() {
   joltages[num_joltages] = joltages[num_joltages - 1] + 3;
   num_joltages++;
 
-  long *memo = malloc(sizeof(long) * test_arr_size);
+  long *memo = arena_alloc(&arena, sizeof(long) * test_arr_size);
   memset(memo, -1, sizeof(long) * num_joltages);
 
   long p = validPermutationsMemoized(joltages, memo, num_joltages, 0);
   printf("Test data (now, with memoization): found %ld valid chains\n", p);
 
   assert(p == 19208L);
+
+  arena_free(&arena);
+}
+
+/**
+ * Counting by runs should agree with counting one adapter at a time, and
+ * shouldn't care how long the runs are.
+ */
+void test2_runs() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  int test_arr_size = 400;
+  int *joltages = arena_alloc(&arena, sizeof(int) * test_arr_size);
+  joltage_run_t *runs = arena_alloc(&arena, sizeof(joltage_run_t) * test_arr_size);
+
+  int num_joltages = readJoltages("day10_test_data.txt", joltages, test_arr_size);
+  int n_runs = compressJoltages(joltages, num_joltages, runs);
+  assert(validPermutationsRuns(runs, n_runs) == 19208);
+
+  num_joltages = readJoltages("day10_data.txt", joltages, test_arr_size);
+  n_runs = compressJoltages(joltages, num_joltages, runs);
+  printf("Real data: %d joltages in %d runs\n", num_joltages, n_runs);
+  assert(validPermutationsRuns(runs, n_runs) == 13816758796288UL);
+
+  // One adapter after another from the outlet: 1, 2, 4, 7, 13, ...
+  uint64_t tribonacci[] = { 1, 1, 2, 4, 7, 13, 24, 44 };
+  for (long length = 1; length < 8; ++length) {
+    joltage_run_t run = { 1, length };
+    assert(validPermutationsRuns(&run, 1) == tribonacci[length]);
+  }
+
+  // Too big a gap anywhere and nothing gets through.
+  joltage_run_t stranded[] = { { 1, 5 }, { 4, 5 } };
+  assert(validPermutationsRuns(stranded, 2) == 0);
+
+  // Splitting a run in two (a 1-jolt gap between the halves) changes nothing,
+  // even a trillion joltages long.
+  long trillion = 1000000000000L;
+  joltage_run_t whole[] = { { 2, 2 * trillion + 1 }, { 3, 7 } };
+  joltage_run_t halves[] = { { 2, trillion }, { 1, trillion + 1 }, { 3, 7 } };
+  assert(validPermutationsRuns(whole, 2) == validPermutationsRuns(halves, 3));
+
+  // Repeats aren't a set of joltages.
+  int repeated[] = { 0, 1, 1, 2 };
+  assert(compressJoltages(repeated, 4, runs) == -1);
+
+  arena_free(&arena);
+}
+
+/**
+ * The solver should take a file of any length, not cut it short.
+ */
+void test_solve_sizes() {
+  int sizes[] = { 2000, 3000 };
+  for (int s = 0; s < 2; ++s) {
+    char path[] = "/tmp/day10_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *fp = fdopen(fd, "w");
+    for (int j = sizes[s]; j >= 1; --j) {
+      fprintf(fp, "%d\n", j);
+    }
+    fclose(fp);
+
+    // One long run of 1-jolt steps, then 3 up to the device.
+    char answer[64], expected[64];
+    bool ok = day10_solve(1, path, answer, sizeof(answer));
+    assert(ok);
+    snprintf(expected, sizeof(expected), "%d", sizes[s]);
+    assert(strcmp(answer, expected) == 0);
+
+    ok = day10_solve(2, path, answer, sizeof(answer));
+    assert(ok);
+    joltage_run_t run = { 1, sizes[s] };
+    snprintf(expected, sizeof(expected), "%lu", (unsigned long) validPermutationsRuns(&run, 1));
+    assert(strcmp(answer, expected) == 0);
+
+    unlink(path);
+  }
+  printf("yay! day10_solve reads the whole file.\n");
 }
 
 void run2() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
   int test_arr_size = 400;
   int num_joltages;
-  int *joltages = malloc(sizeof(int) * test_arr_size);
+  int *joltages = arena_alloc(&arena, sizeof(int) * test_arr_size);
 
   num_joltages = readJoltages("day10_data.txt", joltages, test_arr_size);
 
@@ -239,21 +517,124 @@ void run2() {
   joltages[num_joltages] = joltages[num_joltages - 1] + 3;
   num_joltages++;
 
-  long *memo = malloc(sizeof(long) * test_arr_size);
+  long *memo = arena_alloc(&arena, sizeof(long) * test_arr_size);
   memset(memo, -1, sizeof(long) * num_joltages);
 
   long p = validPermutationsMemoized(joltages, memo, num_joltages, 0);
   printf("Real data (now, with memoization): found %ld valid chains\n", p);
   printf("                  For sanity, LONG_MAX = %ld\n", LONG_MAX);
+
+  arena_free(&arena);
+}
+
+/*
+ * Benchmarks: a sorted chain of joltages, mostly 3 apart, with twenty short
+ * runs of 1-jolt steps so the count is big but still fits in a long.
+ */
+typedef struct chain_bench {
+  int *joltages;
+  long *memo;
+  int size;
+} chain_bench_t;
+
+void* setup_chain(long size, uint64_t seed) {
+  chain_bench_t *bench = malloc(sizeof(chain_bench_t));
+  bench->size = (int) size;
+  // validPermutationsMemoized peeks one past the end.
+  bench->joltages = malloc(sizeof(int) * (size + 1));
+  bench->memo = malloc(sizeof(long) * size);
+
+  bench->joltages[0] = 0;
+  for (long i = 1; i < size; ++i) {
+    bench->joltages[i] = bench->joltages[i - 1] + 3;
+  }
+  for (int run = 0; run < 20; ++run) {
+    long start = 1 + bench_random(&seed) % (size - 5);
+    for (long i = start; i < start + 4; ++i) {
+      bench->joltages[i] = bench->joltages[i - 1] + 1;
+    }
+  }
+  for (long i = 1; i < size; ++i) {
+    if (bench->joltages[i] <= bench->joltages[i - 1]) {
+      bench->joltages[i] = bench->joltages[i - 1] + 1;
+    } else if (bench->joltages[i] - bench->joltages[i - 1] > 3) {
+      bench->joltages[i] = bench->joltages[i - 1] + 3;
+    }
+  }
+  bench->joltages[size] = INT_MAX;
+  return bench;
 }
 
+void run_chain(void *state) {
+  chain_bench_t *bench = state;
+  memset(bench->memo, -1, sizeof(long) * bench->size);
+  PROF_SCOPE("validPermutationsMemoized");
+  long p = validPermutationsMemoized(bench->joltages, bench->memo, bench->size, 0);
+  assert(p > 0);
+}
+
+void teardown_chain(void *state) {
+  chain_bench_t *bench = state;
+  free(bench->joltages);
+  free(bench->memo);
+  free(bench);
+}
+
+/*
+ * Runs of 1 to a million adapters, 1 to 3 jolts apart, so the larger sizes
+ * span around 10^12 joltages.
+ */
+typedef struct runs_bench {
+  joltage_run_t *runs;
+  int size;
+} runs_bench_t;
+
+void* setup_runs(long size, uint64_t seed) {
+  runs_bench_t *bench = malloc(sizeof(runs_bench_t));
+  bench->size = (int) size;
+  bench->runs = malloc(sizeof(joltage_run_t) * size);
+
+  for (long i = 0; i < size; ++i) {
+    bench->runs[i].gap = 1 + bench_random(&seed) % 3;
+    bench->runs[i].length = 1 + bench_random(&seed) % 1000000;
+  }
+  return bench;
+}
+
+void run_runs(void *state) {
+  runs_bench_t *bench = state;
+  volatile uint64_t p = validPermutationsRuns(bench->runs, bench->size);
+  (void) p;
+}
+
+void teardown_runs(void *state) {
+  runs_bench_t *bench = state;
+  free(bench->runs);
+  free(bench);
+}
+
+// The memoized count recurses once per adapter, so keep it off the end of
+// the stack.
+const bench_kernel_t kernels[] = {
+  { "day10", "validPermutationsMemoized", 5, setup_chain, run_chain, teardown_chain, NULL },
+  { "day10", "validPermutationsRuns", 6, setup_runs, run_runs, teardown_runs, NULL },
+};
+
 int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return bench_main(argc, argv, kernels, sizeof(kernels) / sizeof(kernels[0]));
+  }
+
   test();
 
   run();
 
   test2_dumb_recursion();
   test2_memoized();
+  test2_runs();
+  test_solve_sizes();
 
   run2();
 }
+
+#endif
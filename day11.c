@@ -3,6 +3,14 @@
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <time.h>
+
+#include "input.h"
+#include "bench.h"
+#include "arena.h"
+#include "pool.h"
+#include "aoc.h"
+#include "prof.h"
 
 typedef struct seating {
   int rows;
@@ -19,45 +27,66 @@ typedef enum {
   OCCUPIED
 } seat_t;
 
+/**
+ * Copy a grid view of the input into state, checking every seat.
+ *
+ * Return false on anything that isn't a seat or floor.
+ */
+static bool copySeats(const input_t* input, int stride, char* state, int rows, int cols) {
+  for (int row = 0; row < rows; ++row) {
+    const char *line = input->data + (size_t) row * stride;
+    for (int col = 0; col < cols; ++col) {
+      switch (line[col]) {
+        // Valid entries
+        case 'L':  // Open seat
+        case '.':  // Floor
+        case '#':  // Occupied seat
+          break;
+        default:
+          aoc_warn("omg wat: '%c'\n", line[col]);
+          return false;
+      }
+    }
+    memcpy(state + row * cols, line, cols);
+  }
+  return true;
+}
+
 /**
  * Let's make our lives a little easier and know rows and cols ahead of time.
+ *
+ * The grids come out of the run's arena and go away with it.
  */
 void readSeatingChart(const char* filename,
                       seating_t* seating,
                       int rows,
-                      int cols) {
+                      int cols,
+                      arena_t* arena) {
 
   seating->rows = rows;
   seating->cols = cols;
-  seating->last_state = malloc(sizeof(char) * rows * cols);
-  seating->state = malloc(sizeof(char) * rows * cols);
-  seating->next_state = malloc(sizeof(char) * rows * cols);
-
-  int row = 0;
-  int col = 0;
-  char c;
-
-  FILE *fp = fopen(filename, "r");
-  assert(fp);
-
-  while((c = getc(fp)) != EOF) {
-    switch (c) {
-      // Valid entries
-      case 'L':  // Open seat
-      case '.':  // Floor
-      case '#':  // Occupied seat
-        seating->state[row * cols + col] = c;
-        col++;
-        break;
-      case '\n':
-        row++;
-        col = 0;
-        break;
-      default:
-        printf("omg wat: '%c'\n", c);
-        exit(-1);
-    }
+  seating->last_state = arena_alloc(arena, sizeof(char) * rows * cols);
+  seating->state = arena_alloc(arena, sizeof(char) * rows * cols);
+  seating->next_state = arena_alloc(arena, sizeof(char) * rows * cols);
+
+  input_t input;
+  if (!input_open(filename, &input)) {
+    exit(-1);
+  }
+
+  int file_rows, file_cols, stride;
+  if (!input_grid(&input, &file_rows, &file_cols, &stride)) {
+    printf("wat: %s isn't a grid\n", filename);
+    exit(-1);
+  }
+  assert(file_rows == rows && file_cols == cols);
+
+  if (!copySeats(&input, stride, seating->state, rows, cols)) {
+    exit(-1);
   }
+
+  input_report(&input, filename);
+  input_close(&input);
 }
 
 void printSeatingChart(seating_t* seating) {
@@ -151,6 +180,28 @@ int line_of_sight_neighbors(seating_t* seating, int row, int col) {
 }
 
 
+/**
+ * Zobrist key for an occupied seat at pos. A chart's hash is the xor of the
+ * keys of its occupied seats, so a generation updates it with one xor per
+ * seat that flipped.
+ */
+static inline uint64_t zobrist_key(int pos) {
+  uint64_t z = (uint64_t) pos * 0x9E3779B97F4A7C15ULL + 0x2020;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+uint64_t seating_hash(seating_t *seating) {
+  uint64_t hash = 0;
+  for (int k = 0; k < seating->rows * seating->cols; ++k) {
+    if (seating->state[k] == '#') {
+      hash ^= zobrist_key(k);
+    }
+  }
+  return hash;
+}
+
 /**
  * - If a seat is empty (L) and there are no occupied seats adjacent to it, the
  *   seat becomes occupied.
@@ -160,11 +211,15 @@ int line_of_sight_neighbors(seating_t* seating, int row, int col) {
  *
  * - Otherwise, the seat's state does not change.
  *
- * Return true if position is same as last position.
+ * Return how many seats flipped, and xor their Zobrist keys into *hash.
  */
-bool tick(seating_t *seating,
-          int (*neighbors_strategy)(seating_t*, int, int),
-          int too_crowded) {
+static int advance_hashed(seating_t *seating,
+                          int (*neighbors_strategy)(seating_t*, int, int),
+                          int too_crowded,
+                          uint64_t *hash) {
+  PROF_SCOPE("advance");
+  int changed = 0;
+
   for (int i = 0; i < seating->rows; ++i) {
     for (int j = 0; j < seating->cols; ++j) {
       int pos = i * seating->cols + j;
@@ -185,6 +240,11 @@ bool tick(seating_t *seating,
           seating->next_state[pos] = seating->state[pos];
           break;
       }
+
+      if (seating->next_state[pos] != seating->state[pos]) {
+        changed++;
+        *hash ^= zobrist_key(pos);
+      }
     }
   }
 
@@ -194,16 +254,36 @@ bool tick(seating_t *seating,
   seating->state = seating->next_state;
   seating->next_state = temp;
 
+  return changed;
+}
+
+/**
+ * Same as tick, but quietly. Return true if position is same as last position.
+ */
+bool advance(seating_t *seating,
+             int (*neighbors_strategy)(seating_t*, int, int),
+             int too_crowded) {
+  uint64_t hash = 0;
+  return advance_hashed(seating, neighbors_strategy, too_crowded, &hash) == 0;
+}
+
+/**
+ * Advance one generation and print the result.
+ *
+ * Return true if position is same as last position.
+ */
+bool tick(seating_t *seating,
+          int (*neighbors_strategy)(seating_t*, int, int),
+          int too_crowded) {
+  bool converged = advance(seating, neighbors_strategy, too_crowded);
+
   printSeatingChart(seating);
   printf("\n");
 
-  for (int i = 0; i < seating->rows * seating->cols; ++i) {
-    if (seating->last_state[i] != seating->state[i]) {
-      return false;
-    }
+  if (converged) {
+    printf("converged!\n");
   }
-  printf("converged!\n");
-  return true;
+  return converged;
 }
 
 int occupied_seats(seating_t* seating) {
@@ -216,16 +296,625 @@ int occupied_seats(seating_t* seating) {
   return i;
 }
 
+/*
+ * Cycle detection.
+ *
+ * Not every rule settles: some charts flip back and forth forever, which
+ * would keep a while(!advance(...)) loop going for good. Instead, remember
+ * the hash of every generation in an open-addressed table; the first time a
+ * hash comes round again, the chart is in a cycle, and the distance between
+ * the two sightings is its length. A fixed point is a cycle of length 1.
+ *
+ * Equal hashes only suggest equal charts, so a sighting is checked before
+ * it's believed: the chart has to come back to itself within that many
+ * generations. If it comes back sooner, the hashes collided but the chart is
+ * cycling anyway, and the cycle's start is found by replaying from the
+ * first generation. If it doesn't come back at all, the search carries on.
+ */
+typedef struct seen_hashes {
+  uint64_t *hashes;
+  int *generations;   // -1 for an empty slot.
+  int capacity;       // Power of two.
+  int count;
+} seen_hashes_t;
+
+static void seen_init(seen_hashes_t *seen, int capacity) {
+  seen->capacity = capacity;
+  seen->count = 0;
+  seen->hashes = malloc(sizeof(uint64_t) * capacity);
+  seen->generations = malloc(sizeof(int) * capacity);
+  memset(seen->generations, -1, sizeof(int) * capacity);
+}
+
+static void seen_free(seen_hashes_t *seen) {
+  free(seen->hashes);
+  free(seen->generations);
+}
+
+/**
+ * Record hash as seen in generation, unless it's been seen before.
+ *
+ * Return the generation it was first seen in, or -1 if it's new.
+ */
+static int seen_insert(seen_hashes_t *seen, uint64_t hash, int generation) {
+  if (2 * (seen->count + 1) > seen->capacity) {
+    seen_hashes_t bigger;
+    seen_init(&bigger, seen->capacity * 2);
+    for (int i = 0; i < seen->capacity; ++i) {
+      if (seen->generations[i] != -1) {
+        seen_insert(&bigger, seen->hashes[i], seen->generations[i]);
+      }
+    }
+    seen_free(seen);
+    *seen = bigger;
+  }
+
+  int mask = seen->capacity - 1;
+  for (int i = (int) (hash & mask); ; i = (i + 1) & mask) {
+    if (seen->generations[i] == -1) {
+      seen->hashes[i] = hash;
+      seen->generations[i] = generation;
+      seen->count++;
+      return -1;
+    }
+    if (seen->hashes[i] == hash) {
+      return seen->generations[i];
+    }
+  }
+}
+
+static void seating_clone(const seating_t *from, seating_t *to) {
+  size_t size = (size_t) from->rows * from->cols;
+  to->rows = from->rows;
+  to->cols = from->cols;
+  to->state = malloc(size);
+  to->last_state = malloc(size);
+  to->next_state = malloc(size);
+  memcpy(to->state, from->state, size);
+}
+
+static void seating_release(seating_t *seating) {
+  free(seating->state);
+  free(seating->last_state);
+  free(seating->next_state);
+}
+
+/**
+ * Advance until the chart is back where it is now, for at most max_steps
+ * generations.
+ *
+ * Return how many generations that took, or -1 if it didn't come back.
+ */
+static int return_time(seating_t *seating,
+                       int (*neighbors_strategy)(seating_t*, int, int),
+                       int too_crowded,
+                       uint64_t *hash,
+                       int max_steps) {
+  size_t size = (size_t) seating->rows * seating->cols;
+  char *start = malloc(size);
+  memcpy(start, seating->state, size);
+
+  int steps = -1;
+  for (int t = 1; t <= max_steps; ++t) {
+    advance_hashed(seating, neighbors_strategy, too_crowded, hash);
+    if (memcmp(seating->state, start, size) == 0) {
+      steps = t;
+      break;
+    }
+  }
+
+  free(start);
+  return steps;
+}
+
+/**
+ * The first generation, counting from initial, that's already in a cycle of
+ * length period: the first one equal to the one period generations later.
+ */
+static int cycle_start(const seating_t *initial,
+                       int (*neighbors_strategy)(seating_t*, int, int),
+                       int too_crowded,
+                       int period) {
+  size_t size = (size_t) initial->rows * initial->cols;
+  seating_t slow, fast;
+  seating_clone(initial, &slow);
+  seating_clone(initial, &fast);
+
+  uint64_t ignored = 0;
+  for (int t = 0; t < period; ++t) {
+    advance_hashed(&fast, neighbors_strategy, too_crowded, &ignored);
+  }
+
+  int start = 0;
+  while (memcmp(slow.state, fast.state, size) != 0) {
+    advance_hashed(&slow, neighbors_strategy, too_crowded, &ignored);
+    advance_hashed(&fast, neighbors_strategy, too_crowded, &ignored);
+    start++;
+  }
+
+  seating_release(&slow);
+  seating_release(&fast);
+  return start;
+}
+
+/**
+ * Advance until the chart repeats a generation it's been in before, and stop
+ * there. Return the length of the cycle (1 if it settled), and set *lead_in
+ * to the number of generations before the cycle starts.
+ *
+ * For a chart that settles, the lead in is what while(!advance(...)) counts.
+ */
+int run_to_cycle(seating_t *seating,
+                 int (*neighbors_strategy)(seating_t*, int, int),
+                 int too_crowded,
+                 int *lead_in) {
+  seen_hashes_t seen;
+  seen_init(&seen, 256);
+
+  // Just the chart, to replay from if the hashes mislead us.
+  size_t size = (size_t) seating->rows * seating->cols;
+  seating_t initial = { seating->rows, seating->cols, NULL, malloc(size), NULL };
+  memcpy(initial.state, seating->state, size);
+
+  uint64_t hash = seating_hash(seating);
+  int generation = 0;
+  int period = 0;
+  while (period == 0) {
+    int first = seen_insert(&seen, hash, generation);
+    if (first == -1) {
+      advance_hashed(seating, neighbors_strategy, too_crowded, &hash);
+      generation++;
+      continue;
+    }
+
+    // A real repeat comes back after exactly generation - first.
+    int sighted = generation - first;
+    int back = return_time(seating, neighbors_strategy, too_crowded, &hash, sighted);
+    if (back == sighted) {
+      *lead_in = first;
+      period = back;
+    } else if (back > 0) {
+      *lead_in = cycle_start(&initial, neighbors_strategy, too_crowded, back);
+      period = back;
+    } else {
+      generation += sighted;
+    }
+  }
+
+  free(initial.state);
+  seen_free(&seen);
+  return period;
+}
+
+/*
+ * Hashlife-style engine for the immediate-neighbor rule.
+ *
+ * The chart is stored as a quadtree of hash-consed macrocells: identical
+ * blocks of seats share one node, and each node caches its own future (the
+ * center half, 2^(level-2) generations on). Floor never changes and has no
+ * occupied neighbors, so padding the chart with floor out to a power of two
+ * behaves exactly like the bounds checks in immediate_neighbors.
+ *
+ * Line of sight neighbors aren't local, so this only works for part 1 rules.
+ */
+typedef struct macrocell {
+  int level;                  // Covers 2^level x 2^level seats.
+  char seat;                  // Seat state, for level 0 only.
+  int occupied;
+  struct macrocell *nw;
+  struct macrocell *ne;
+  struct macrocell *sw;
+  struct macrocell *se;
+  struct macrocell *result;   // Memoized future, or NULL.
+  struct macrocell *next;     // Hash chain.
+} macrocell_t;
+
+typedef struct hashlife {
+  int too_crowded;
+  int rows;
+  int cols;
+  long generation;
+  macrocell_t *root;
+  macrocell_t *floor;
+  macrocell_t *available;
+  macrocell_t *occupied;
+  macrocell_t **buckets;
+  int n_buckets;
+  int n_nodes;
+} hashlife_t;
+
+static macrocell_t* new_leaf(char seat) {
+  macrocell_t *leaf = calloc(1, sizeof(macrocell_t));
+  leaf->seat = seat;
+  leaf->occupied = (seat == '#') ? 1 : 0;
+  return leaf;
+}
+
+static unsigned long macrocell_hash(macrocell_t *nw, macrocell_t *ne,
+                                    macrocell_t *sw, macrocell_t *se) {
+  unsigned long h = (unsigned long) nw;
+  h = h * 31 + (unsigned long) ne;
+  h = h * 31 + (unsigned long) sw;
+  h = h * 31 + (unsigned long) se;
+  return h ^ (h >> 17);
+}
+
+static void hashlife_grow(hashlife_t *hl) {
+  int n_buckets = hl->n_buckets * 2;
+  macrocell_t **buckets = calloc(n_buckets, sizeof(macrocell_t*));
+
+  for (int i = 0; i < hl->n_buckets; ++i) {
+    macrocell_t *node = hl->buckets[i];
+    while (node) {
+      macrocell_t *next = node->next;
+      unsigned long h = macrocell_hash(node->nw, node->ne, node->sw, node->se);
+      node->next = buckets[h % n_buckets];
+      buckets[h % n_buckets] = node;
+      node = next;
+    }
+  }
+
+  free(hl->buckets);
+  hl->buckets = buckets;
+  hl->n_buckets = n_buckets;
+}
+
+/**
+ * Return the unique node with these four quadrants, creating it if needed.
+ */
+macrocell_t* hashlife_node(hashlife_t *hl,
+                           macrocell_t *nw, macrocell_t *ne,
+                           macrocell_t *sw, macrocell_t *se) {
+  unsigned long h = macrocell_hash(nw, ne, sw, se);
+
+  for (macrocell_t *node = hl->buckets[h % hl->n_buckets]; node; node = node->next) {
+    if (node->nw == nw && node->ne == ne && node->sw == sw && node->se == se) {
+      return node;
+    }
+  }
+
+  macrocell_t *node = calloc(1, sizeof(macrocell_t));
+  node->level = nw->level + 1;
+  node->occupied = nw->occupied + ne->occupied + sw->occupied + se->occupied;
+  node->nw = nw;
+  node->ne = ne;
+  node->sw = sw;
+  node->se = se;
+  node->next = hl->buckets[h % hl->n_buckets];
+  hl->buckets[h % hl->n_buckets] = node;
+
+  if (++hl->n_nodes > hl->n_buckets) {
+    hashlife_grow(hl);
+  }
+
+  return node;
+}
+
+macrocell_t* hashlife_empty(hashlife_t *hl, int level) {
+  if (level == 0) {
+    return hl->floor;
+  }
+  macrocell_t *e = hashlife_empty(hl, level - 1);
+  return hashlife_node(hl, e, e, e, e);
+}
+
+static char macrocell_seat(macrocell_t *node, int row, int col) {
+  while (node->level > 0) {
+    int half = 1 << (node->level - 1);
+    if (row < half) {
+      node = (col < half) ? node->nw : node->ne;
+    } else {
+      node = (col < half) ? node->sw : node->se;
+      row -= half;
+    }
+    if (col >= half) {
+      col -= half;
+    }
+  }
+  return node->seat;
+}
+
+static macrocell_t* leaf_for(hashlife_t *hl, char seat) {
+  switch (seat) {
+    case 'L':
+      return hl->available;
+    case '#':
+      return hl->occupied;
+    default:
+      return hl->floor;
+  }
+}
+
+static macrocell_t* build_macrocell(hashlife_t *hl, seating_t *seating,
+                                    int level, int row, int col) {
+  if (row >= seating->rows || col >= seating->cols) {
+    return hashlife_empty(hl, level);
+  }
+  if (level == 0) {
+    return leaf_for(hl, seat_at(seating, row, col));
+  }
+
+  int half = 1 << (level - 1);
+  return hashlife_node(hl,
+      build_macrocell(hl, seating, level - 1, row, col),
+      build_macrocell(hl, seating, level - 1, row, col + half),
+      build_macrocell(hl, seating, level - 1, row + half, col),
+      build_macrocell(hl, seating, level - 1, row + half, col + half));
+}
+
+/**
+ * Base case: a 4x4 block, advanced one generation with the same rule as
+ * tick, leaves its center 2x2 block.
+ */
+static macrocell_t* base_result(hashlife_t *hl, macrocell_t *node) {
+  char grid[4][4];
+  macrocell_t *out[4];
+
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      grid[r][c] = macrocell_seat(node, r, c);
+    }
+  }
+
+  for (int r = 1; r <= 2; ++r) {
+    for (int c = 1; c <= 2; ++c) {
+      int k = 0;
+      for (int dr = -1; dr <= 1; ++dr) {
+        for (int dc = -1; dc <= 1; ++dc) {
+          if ((dr || dc) && grid[r + dr][c + dc] == '#') {
+            k++;
+          }
+        }
+      }
+
+      char next = grid[r][c];
+      if (next == 'L' && k == 0) {
+        next = '#';
+      } else if (next == '#' && k >= hl->too_crowded) {
+        next = 'L';
+      }
+      out[(r - 1) * 2 + (c - 1)] = leaf_for(hl, next);
+    }
+  }
+
+  return hashlife_node(hl, out[0], out[1], out[2], out[3]);
+}
+
+/**
+ * Return the center quadrant of node, 2^(level-2) generations later.
+ */
+macrocell_t* macrocell_result(hashlife_t *hl, macrocell_t *node) {
+  if (node->result) {
+    return node->result;
+  }
+
+  // Floor alone stays floor forever.
+  if (node->occupied == 0 && node == hashlife_empty(hl, node->level)) {
+    node->result = hashlife_empty(hl, node->level - 1);
+    return node->result;
+  }
+
+  if (node->level == 2) {
+    node->result = base_result(hl, node);
+    return node->result;
+  }
+
+  macrocell_t *nw = node->nw, *ne = node->ne, *sw = node->sw, *se = node->se;
+
+  // Nine overlapping subnodes, each advanced 2^(level-3) generations.
+  macrocell_t *r00 = macrocell_result(hl, nw);
+  macrocell_t *r01 = macrocell_result(hl, hashlife_node(hl, nw->ne, ne->nw, nw->se, ne->sw));
+  macrocell_t *r02 = macrocell_result(hl, ne);
+  macrocell_t *r10 = macrocell_result(hl, hashlife_node(hl, nw->sw, nw->se, sw->nw, sw->ne));
+  macrocell_t *r11 = macrocell_result(hl, hashlife_node(hl, nw->se, ne->sw, sw->ne, se->nw));
+  macrocell_t *r12 = macrocell_result(hl, hashlife_node(hl, ne->sw, ne->se, se->nw, se->ne));
+  macrocell_t *r20 = macrocell_result(hl, sw);
+  macrocell_t *r21 = macrocell_result(hl, hashlife_node(hl, sw->ne, se->nw, sw->se, se->sw));
+  macrocell_t *r22 = macrocell_result(hl, se);
+
+  // ... then combined into four and advanced another 2^(level-3).
+  node->result = hashlife_node(hl,
+      macrocell_result(hl, hashlife_node(hl, r00, r01, r10, r11)),
+      macrocell_result(hl, hashlife_node(hl, r01, r02, r11, r12)),
+      macrocell_result(hl, hashlife_node(hl, r10, r11, r20, r21)),
+      macrocell_result(hl, hashlife_node(hl, r11, r12, r21, r22)));
+  return node->result;
+}
+
+/**
+ * Load a seating chart into a new hashlife engine for the given rule.
+ */
+hashlife_t* hashlife_new(seating_t *seating, int too_crowded) {
+  hashlife_t *hl = calloc(1, sizeof(hashlife_t));
+  hl->too_crowded = too_crowded;
+  hl->rows = seating->rows;
+  hl->cols = seating->cols;
+  hl->n_buckets = 1024;
+  hl->buckets = calloc(hl->n_buckets, sizeof(macrocell_t*));
+  hl->floor = new_leaf('.');
+  hl->available = new_leaf('L');
+  hl->occupied = new_leaf('#');
+
+  int level = 2;
+  while ((1 << level) < seating->rows || (1 << level) < seating->cols) {
+    level++;
+  }
+
+  hl->root = build_macrocell(hl, seating, level, 0, 0);
+  return hl;
+}
+
+/**
+ * Advance the whole chart 2^(level-1) generations in one step.
+ *
+ * Return the number of generations advanced.
+ */
+long hashlife_step(hashlife_t *hl) {
+  macrocell_t *root = hl->root;
+  macrocell_t *e = hashlife_empty(hl, root->level - 1);
+
+  // Pad with floor so the result is the whole chart.
+  macrocell_t *padded = hashlife_node(hl,
+      hashlife_node(hl, e, e, e, root->nw),
+      hashlife_node(hl, e, e, root->ne, e),
+      hashlife_node(hl, e, root->sw, e, e),
+      hashlife_node(hl, root->se, e, e, e));
+
+  hl->root = macrocell_result(hl, padded);
+
+  long generations = 1L << (root->level - 1);
+  hl->generation += generations;
+  return generations;
+}
+
+/**
+ * Copy the engine's current chart into seating->state.
+ */
+void hashlife_write(hashlife_t *hl, seating_t *seating) {
+  for (int i = 0; i < hl->rows; ++i) {
+    for (int j = 0; j < hl->cols; ++j) {
+      seating->state[i * seating->cols + j] = macrocell_seat(hl->root, i, j);
+    }
+  }
+}
+
+void hashlife_free(hashlife_t *hl) {
+  for (int i = 0; i < hl->n_buckets; ++i) {
+    macrocell_t *node = hl->buckets[i];
+    while (node) {
+      macrocell_t *next = node->next;
+      free(node);
+      node = next;
+    }
+  }
+  free(hl->buckets);
+  free(hl->floor);
+  free(hl->available);
+  free(hl->occupied);
+  free(hl);
+}
+
+/*
+ * Batch mode: simulate many small charts to convergence at once.
+ *
+ * Charts are handed out by pool.h, so each one is carved out of its
+ * worker's arena and, after the biggest chart so far, makes no allocator
+ * calls.
+ */
+typedef struct chart_job {
+  const char *filename;
+  int (*neighbors_strategy)(seating_t*, int, int);
+  int too_crowded;
+
+  // Results.
+  bool ok;
+  int rows;
+  int cols;
+  int iterations;   // Before it settles, or starts to cycle.
+  int period;       // 1 if it settles.
+  int occupied;
+} chart_job_t;
+
+/**
+ * Read a chart of any size, with its three grids in the arena.
+ *
+ * Return false if the file can't be read or isn't a rectangular chart.
+ */
+bool loadSeatingChart(const char* filename,
+                      seating_t* seating,
+                      arena_t* arena) {
+  input_t input;
+  if (!input_open(filename, &input)) {
+    return false;
+  }
+
+  int rows, cols, stride;
+  bool ok = input_grid(&input, &rows, &cols, &stride) && rows > 0;
+
+  if (ok) {
+    size_t size = (size_t) rows * cols;
+
+    seating->rows = rows;
+    seating->cols = cols;
+    seating->state = arena_alloc(arena, size);
+    seating->last_state = arena_alloc(arena, size);
+    seating->next_state = arena_alloc(arena, size);
+    ok = copySeats(&input, stride, seating->state, rows, cols);
+  }
+
+  input_close(&input);
+  return ok;
+}
+
+static void run_chart_job(void *arg, arena_t *arena) {
+  chart_job_t *job = arg;
+  seating_t seating;
+
+  job->ok = loadSeatingChart(job->filename, &seating, arena);
+  if (!job->ok) {
+    return;
+  }
+
+  job->period = run_to_cycle(&seating, job->neighbors_strategy, job->too_crowded,
+                             &job->iterations);
+  job->rows = seating.rows;
+  job->cols = seating.cols;
+  job->occupied = occupied_seats(&seating);
+}
+
+/**
+ * Simulate every job's chart to convergence on n_threads threads. Results
+ * are written back into each job.
+ */
+void simulate_charts(chart_job_t *jobs, int n_jobs, int n_threads) {
+  pool_run(jobs, sizeof(chart_job_t), n_jobs, n_threads, run_chart_job);
+}
+
+/**
+ * Occupied seats once the chart settles: part 1 by the immediate-neighbor
+ * rule, part 2 by line of sight. There's no answer if it never settles.
+ */
+bool day11_solve(int part, const char *path, char *answer, size_t answer_size) {
+  PROF_SCOPE("day11_solve");
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t seating;
+  bool ok = loadSeatingChart(path, &seating, &arena);
+  if (ok) {
+    int lead_in;
+    int period = (part == 1)
+      ? run_to_cycle(&seating, &immediate_neighbors, 4, &lead_in)
+      : run_to_cycle(&seating, &line_of_sight_neighbors, 5, &lead_in);
+
+    ok = (period == 1);
+    if (ok) {
+      snprintf(answer, answer_size, "%d", occupied_seats(&seating));
+    }
+  }
+
+  arena_free(&arena);
+  return ok;
+}
+
+#ifndef AOC_LIBRARY
+
 void test_read() {
-  seating_t* seating = malloc(sizeof(seating_t));
-  readSeatingChart("day11_test_data.txt", seating, 10, 10);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* seating = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_test_data.txt", seating, 10, 10, &arena);
   printSeatingChart(seating);
-  // Free? :)
+  arena_free(&arena);
 }
 
 void test_tick() {
-  seating_t* seating = malloc(sizeof(seating_t));
-  readSeatingChart("day11_test_data.txt", seating, 10, 10);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* seating = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_test_data.txt", seating, 10, 10, &arena);
 
   int i = 0;
   while(!tick(seating, &immediate_neighbors, 4)) ++i;
@@ -233,22 +922,30 @@ void test_tick() {
   printf("%d iterations\n", i);
 
   assert(occupied_seats(seating) == 37);
+  arena_free(&arena);
 }
 
 void part1() {
-  seating_t* seating = malloc(sizeof(seating_t));
-  readSeatingChart("day11_data.txt", seating, 97, 91);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* seating = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_data.txt", seating, 97, 91, &arena);
 
   int i = 0;
   while(!tick(seating, &immediate_neighbors, 4)) ++i ;
 
   printf("%d iterations\n", i);
   printf("%d occupied seats\n", occupied_seats(seating));
+  arena_free(&arena);
 }
 
 void test_line_of_sight() {
-  seating_t* seating = malloc(sizeof(seating_t));
-  readSeatingChart("day11_test_data.txt", seating, 10, 10);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* seating = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_test_data.txt", seating, 10, 10, &arena);
 
   int i = 0;
   while(!tick(seating, &line_of_sight_neighbors, 5)) ++i;
@@ -256,28 +953,217 @@ void test_line_of_sight() {
   printf("%d iterations\n", i);
 
   assert(occupied_seats(seating) == 26);
+  arena_free(&arena);
 }
 
 void part2() {
-  seating_t* seating = malloc(sizeof(seating_t));
-  readSeatingChart("day11_data.txt", seating, 97, 91);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* seating = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_data.txt", seating, 97, 91, &arena);
 
   int i = 0;
   while(!tick(seating, &line_of_sight_neighbors, 5)) ++i ;
 
   printf("%d iterations\n", i);
   printf("%d occupied seats\n", occupied_seats(seating));
+  arena_free(&arena);
 }
 
+/**
+ * The hashlife engine should agree with tick, generation for generation.
+ */
+void test_hashlife() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* naive = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_data.txt", naive, 97, 91, &arena);
+
+  seating_t* fast = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_data.txt", fast, 97, 91, &arena);
+
+  hashlife_t *hl = hashlife_new(fast, 4);
+
+  // 97x91 pads out to 128x128, so each step is 64 generations.
+  long generations = hashlife_step(hl);
+  assert(generations == 64);
+  for (long i = 0; i < generations; ++i) {
+    tick(naive, &immediate_neighbors, 4);
+  }
+
+  hashlife_write(hl, fast);
+  assert(memcmp(naive->state, fast->state, 97 * 91) == 0);
+
+  // Long since converged; the answer to part 1 should still hold.
+  hashlife_step(hl);
+  while(!tick(naive, &immediate_neighbors, 4));
+
+  hashlife_write(hl, fast);
+  assert(memcmp(naive->state, fast->state, 97 * 91) == 0);
+  assert(hl->root->occupied == occupied_seats(naive));
+  printf("hashlife: %ld generations, %d occupied seats, %d nodes\n",
+         hl->generation, hl->root->occupied, hl->n_nodes);
+
+  hashlife_free(hl);
+  arena_free(&arena);
+}
+
+/**
+ * run_to_cycle should stop where advance does on charts that settle, and
+ * report the period of ones that don't.
+ */
+void test_cycles() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  seating_t* seating = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_test_data.txt", seating, 10, 10, &arena);
+  int settled = 0;
+  while (!advance(seating, &line_of_sight_neighbors, 5)) ++settled;
+
+  seating_t* cycling = arena_alloc(&arena, sizeof(seating_t));
+  readSeatingChart("day11_test_data.txt", cycling, 10, 10, &arena);
+  int lead_in;
+  assert(run_to_cycle(cycling, &line_of_sight_neighbors, 5, &lead_in) == 1);
+  assert(lead_in == settled);
+  assert(memcmp(seating->state, cycling->state, 100) == 0);
+  assert(occupied_seats(cycling) == 26);
+
+  // Two seats side by side that can't stand each other blink forever:
+  // both fill up, then both empty out.
+  seating_t blinker = { 1, 2, NULL, NULL, NULL };
+  blinker.state = arena_alloc(&arena, 2);
+  blinker.last_state = arena_alloc(&arena, 2);
+  blinker.next_state = arena_alloc(&arena, 2);
+  memcpy(blinker.state, "LL", 2);
+  assert(run_to_cycle(&blinker, &immediate_neighbors, 1, &lead_in) == 2);
+  assert(lead_in == 0);
+  assert(memcmp(blinker.state, "LL", 2) == 0);
+
+  // A seat with a single neighbor flips every generation; a lone seat fills
+  // up and stays full.
+  seating_t row = { 1, 4, NULL, NULL, NULL };
+  row.state = arena_alloc(&arena, 4);
+  row.last_state = arena_alloc(&arena, 4);
+  row.next_state = arena_alloc(&arena, 4);
+  memcpy(row.state, "L.LL", 4);
+  assert(run_to_cycle(&row, &immediate_neighbors, 1, &lead_in) == 2);
+  assert(lead_in == 1);
+
+  // The checks behind a hash sighting, on their own.
+  uint64_t hash = 0;
+  assert(return_time(&row, &immediate_neighbors, 1, &hash, 2) == 2);
+  assert(return_time(&row, &immediate_neighbors, 1, &hash, 1) == -1);
+  memcpy(row.state, "L.LL", 4);
+  assert(cycle_start(&row, &immediate_neighbors, 1, 2) == 1);
+  memcpy(blinker.state, "LL", 2);
+  assert(cycle_start(&blinker, &immediate_neighbors, 1, 2) == 0);
+  seating_t fresh;
+  readSeatingChart("day11_test_data.txt", &fresh, 10, 10, &arena);
+  assert(cycle_start(&fresh, &line_of_sight_neighbors, 5, 1) == settled);
+  printf("yay! cycles detected.\n");
+
+  arena_free(&arena);
+}
+
+void test_batch() {
+  int n_jobs = 2000;
+  chart_job_t *jobs = calloc(n_jobs, sizeof(chart_job_t));
+
+  // Alternate part 1 and part 2 rules.
+  for (int i = 0; i < n_jobs; ++i) {
+    jobs[i].filename = "day11_test_data.txt";
+    jobs[i].neighbors_strategy = (i % 2) ? &line_of_sight_neighbors : &immediate_neighbors;
+    jobs[i].too_crowded = (i % 2) ? 5 : 4;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  simulate_charts(jobs, n_jobs, 8);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (int i = 0; i < n_jobs; ++i) {
+    assert(jobs[i].ok);
+    assert(jobs[i].rows == 10 && jobs[i].cols == 10);
+    assert(jobs[i].occupied == ((i % 2) ? 26 : 37));
+    assert(jobs[i].period == 1);
+  }
+
+  double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("batch: %d charts in %.3fs (%.0f charts/s)\n", n_jobs, secs, n_jobs / secs);
+
+  free(jobs);
+}
+
+/*
+ * Benchmarks: one generation on a square chart of random seats and floor.
+ * advance is tick without the printing, which would swamp the timing.
+ */
+void* setup_chart(long size, uint64_t seed) {
+  int side = 1;
+  while ((long) side * side < size) {
+    side++;
+  }
+
+  seating_t *seating = malloc(sizeof(seating_t));
+  seating->rows = side;
+  seating->cols = side;
+  seating->last_state = malloc((size_t) side * side);
+  seating->state = malloc((size_t) side * side);
+  seating->next_state = malloc((size_t) side * side);
+
+  for (long i = 0; i < (long) side * side; ++i) {
+    switch (bench_random(&seed) % 4) {
+      case 0:
+        seating->state[i] = '.';
+        break;
+      case 1:
+        seating->state[i] = '#';
+        break;
+      default:
+        seating->state[i] = 'L';
+        break;
+    }
+  }
+  return seating;
+}
+
+void run_chart(void *state) {
+  advance(state, &immediate_neighbors, 4);
+}
+
+void teardown_chart(void *state) {
+  seating_t *seating = state;
+  free(seating->last_state);
+  free(seating->state);
+  free(seating->next_state);
+  free(seating);
+}
+
+// Three bytes a seat: 10^8 seats is 300 MB, 10^9 would be 3 GB.
+const bench_kernel_t kernels[] = {
+  { "day11", "tick", 8, setup_chart, run_chart, teardown_chart, NULL },
+};
+
 int main (int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return bench_main(argc, argv, kernels, sizeof(kernels) / sizeof(kernels[0]));
+  }
+
   test_read();
   test_tick();
 
   part1();
 
+  test_hashlife();
+  test_cycles();
+  test_batch();
+
   test_line_of_sight();
 
   part2();
 }
 
-
+#endif
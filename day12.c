@@ -2,6 +2,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>  // Build with -pthread.
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "bench.h"
+#include "arena.h"
+#include "aoc.h"
+#include "prof.h"
+#include "pipeline.h"
 
 typedef enum orientation {
   N,
@@ -68,57 +79,29 @@ orientation_t rotate_by(orientation_t orientation, int degrees) {
   return (orientation_t) ((orientation + (degrees / 90)) % 4);
 }
 
-void readInstructions(const char* filename,
-                      opcode_t *opcodes,
-                      int n_opcodes) {
-  int i = 0;
-  int value = 0;
-
-  FILE *fp = fopen(filename, "r");
-  assert(fp);
-
-  char c;
-  while((c = getc(fp)) != EOF) {
-
-    switch(c) {
-      case '\n':
-        // End of line. Save value and prepare for next line.
-        opcodes[i].value = value;
-        value = 0;
-        if (++i > n_opcodes) {
-          printf("oh no! too many instructions to read. At %d of %d.\n", i, n_opcodes);
-          exit(-1);
-        }
-        break;
-
-      case '0':
-      case '1':
-      case '2':
-      case '3':
-      case '4':
-      case '5':
-      case '6':
-      case '7':
-      case '8':
-      case '9':
-        value = value * 10 + (c - '0');
-        break;
-
-      case 'N':
-      case 'S':
-      case 'E':
-      case 'W':
-      case 'L':
-      case 'R':
-      case 'F':
-        opcodes[i].op = c;
-        break;
+static bool is_nav_op(char c) {
+  switch(c) {
+    case 'N':
+    case 'S':
+    case 'E':
+    case 'W':
+    case 'L':
+    case 'R':
+    case 'F':
+      return true;
+    default:
+      return false;
+  }
+}
 
-      default:
-        printf("wat: '%c'\n", c);
-        exit(-1);
+static int line_number(const input_t *input, size_t pos) {
+  int line = 1;
+  for (size_t i = 0; i < pos && i < input->size; ++i) {
+    if (input->data[i] == '\n') {
+      line++;
     }
   }
+  return line;
 }
 
 void execute_wrongly(const opcode_t *opcodes,
@@ -126,7 +109,7 @@ void execute_wrongly(const opcode_t *opcodes,
              coord_t *coords) {
 
   orientation_t dir = E;
-  coord_t *vec = malloc(sizeof(coord_t));
+  coord_t vec;
 
   for (int i = 0; i < n_opcodes; ++i) {
     opcode_t opcode = opcodes[i];
@@ -151,9 +134,9 @@ void execute_wrongly(const opcode_t *opcodes,
         dir = rotate_by(dir, opcode.value);
         break;
       case 'F':
-        vector_for(dir, vec);
-        coords->ns += vec->ns * opcode.value;
-        coords->ew += vec->ew * opcode.value;
+        vector_for(dir, &vec);
+        coords->ns += vec.ns * opcode.value;
+        coords->ew += vec.ew * opcode.value;
         break;
       default:
         printf("wat??\n");
@@ -186,6 +169,7 @@ void execute_correctly(const opcode_t *opcodes,
                        int n_opcodes,
                        coord_t *waypoint,
                        coord_t *location) {
+  PROF_SCOPE("execute_correctly");
 
   for (int i = 0; i < n_opcodes; ++i) {
     opcode_t opcode = opcodes[i];
@@ -227,14 +211,997 @@ void execute_correctly(const opcode_t *opcodes,
   }
 }
 
+/*
+ * Every opcode is an affine map on (waypoint, location):
+ *
+ *   waypoint' = a * waypoint + u
+ *   location' = location + c * waypoint + v
+ *
+ * and maps of that shape compose into another one, so any run of opcodes
+ * boils down to one small transform. For execute_wrongly, "waypoint" is the
+ * ship's unit heading, and N/S/E/W move the location instead.
+ *
+ * Vectors are { ns, ew }.
+ */
+typedef struct nav_transform {
+  long a[2][2];
+  long u[2];
+  long c[2][2];
+  long v[2];
+} nav_transform_t;
+
+void nav_identity(nav_transform_t *t) {
+  memset(t, 0, sizeof(nav_transform_t));
+  t->a[0][0] = 1;
+  t->a[1][1] = 1;
+}
+
+/**
+ * Build the transform for a single opcode.
+ */
+void nav_from_opcode(opcode_t opcode, bool correctly, nav_transform_t *t) {
+  nav_identity(t);
+
+  // Translations move the waypoint, or the ship if we're doing it wrong.
+  long *move = correctly ? t->u : t->v;
+
+  switch(opcode.op) {
+    case 'N':
+      move[0] = opcode.value;
+      break;
+    case 'S':
+      move[0] = -opcode.value;
+      break;
+    case 'E':
+      move[1] = opcode.value;
+      break;
+    case 'W':
+      move[1] = -opcode.value;
+      break;
+    case 'L':
+    case 'R': {
+      // Clockwise quarter turns, same as rotate_about_right.
+      int turns = (opcode.value / 90) % 4;
+      if (opcode.op == 'L') {
+        turns = (4 - turns) % 4;
+      }
+      for (int i = 0; i < turns; ++i) {
+        long ns0 = t->a[0][0], ns1 = t->a[0][1];
+        t->a[0][0] = -t->a[1][0];
+        t->a[0][1] = -t->a[1][1];
+        t->a[1][0] = ns0;
+        t->a[1][1] = ns1;
+      }
+      break;
+    }
+    case 'F':
+      t->c[0][0] = opcode.value;
+      t->c[1][1] = opcode.value;
+      break;
+    default:
+      printf("ugh.\n");
+      exit(-1);
+  }
+}
+
+/**
+ * out = then(first(x)). out may alias either argument.
+ */
+void nav_compose(const nav_transform_t *first,
+                 const nav_transform_t *then,
+                 nav_transform_t *out) {
+  nav_transform_t r;
+
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      r.a[i][j] = then->a[i][0] * first->a[0][j] + then->a[i][1] * first->a[1][j];
+      r.c[i][j] = first->c[i][j]
+                + then->c[i][0] * first->a[0][j] + then->c[i][1] * first->a[1][j];
+    }
+    r.u[i] = then->a[i][0] * first->u[0] + then->a[i][1] * first->u[1] + then->u[i];
+    r.v[i] = first->v[i]
+           + then->c[i][0] * first->u[0] + then->c[i][1] * first->u[1] + then->v[i];
+  }
+
+  *out = r;
+}
+
+void nav_apply(const nav_transform_t *t, coord_t *waypoint, coord_t *location) {
+  long ns = waypoint->ns;
+  long ew = waypoint->ew;
+
+  waypoint->ns = t->a[0][0] * ns + t->a[0][1] * ew + t->u[0];
+  waypoint->ew = t->a[1][0] * ns + t->a[1][1] * ew + t->u[1];
+  location->ns += t->c[0][0] * ns + t->c[0][1] * ew + t->v[0];
+  location->ew += t->c[1][0] * ns + t->c[1][1] * ew + t->v[1];
+}
+
+typedef struct nav_chunk {
+  const opcode_t *opcodes;
+  int start;
+  int end;
+  bool correctly;
+  nav_transform_t total;    // Composition of this chunk's opcodes.
+  nav_transform_t prefix;   // Composition of everything before this chunk.
+  coord_t waypoint;         // Starting state, for the replay pass.
+  coord_t location;
+  coord_t *waypoints;       // Per-step outputs, or NULL.
+  coord_t *locations;
+} nav_chunk_t;
+
+static void* nav_reduce_chunk(void *arg) {
+  nav_chunk_t *chunk = arg;
+  nav_transform_t t;
+
+  nav_identity(&chunk->total);
+  for (int i = chunk->start; i < chunk->end; ++i) {
+    nav_from_opcode(chunk->opcodes[i], chunk->correctly, &t);
+    nav_compose(&chunk->total, &t, &chunk->total);
+  }
+  return NULL;
+}
+
+static void* nav_replay_chunk(void *arg) {
+  nav_chunk_t *chunk = arg;
+  coord_t waypoint = chunk->waypoint;
+  coord_t location = chunk->location;
+  nav_transform_t t;
+
+  nav_apply(&chunk->prefix, &waypoint, &location);
+  for (int i = chunk->start; i < chunk->end; ++i) {
+    nav_from_opcode(chunk->opcodes[i], chunk->correctly, &t);
+    nav_apply(&t, &waypoint, &location);
+    chunk->waypoints[i] = waypoint;
+    chunk->locations[i] = location;
+  }
+  return NULL;
+}
+
+/**
+ * Run the opcodes as a parallel prefix scan over n_threads threads.
+ *
+ * Each thread composes its own slice of the route, the slice totals are
+ * scanned in order, and the final state comes from one apply. If waypoints
+ * and locations are non-NULL, each thread then replays its slice from its
+ * prefix to fill in the state after every instruction.
+ */
+void execute_scan(const opcode_t *opcodes,
+                  int n_opcodes,
+                  bool correctly,
+                  coord_t *waypoint,
+                  coord_t *location,
+                  coord_t *waypoints,
+                  coord_t *locations,
+                  int n_threads) {
+  if (n_threads > n_opcodes) {
+    n_threads = n_opcodes;
+  }
+  if (n_threads < 1) {
+    return;
+  }
+
+  nav_chunk_t *chunks = malloc(sizeof(nav_chunk_t) * n_threads);
+  pthread_t *threads = malloc(sizeof(pthread_t) * n_threads);
+
+  for (int i = 0; i < n_threads; ++i) {
+    chunks[i].opcodes = opcodes;
+    chunks[i].start = (int) ((long) n_opcodes * i / n_threads);
+    chunks[i].end = (int) ((long) n_opcodes * (i + 1) / n_threads);
+    chunks[i].correctly = correctly;
+    chunks[i].waypoint = *waypoint;
+    chunks[i].location = *location;
+    chunks[i].waypoints = waypoints;
+    chunks[i].locations = locations;
+    pthread_create(&threads[i], NULL, nav_reduce_chunk, &chunks[i]);
+  }
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Exclusive scan over the slice totals; only n_threads of them.
+  nav_identity(&chunks[0].prefix);
+  for (int i = 1; i < n_threads; ++i) {
+    nav_compose(&chunks[i - 1].prefix, &chunks[i - 1].total, &chunks[i].prefix);
+  }
+
+  if (waypoints && locations) {
+    for (int i = 0; i < n_threads; ++i) {
+      pthread_create(&threads[i], NULL, nav_replay_chunk, &chunks[i]);
+    }
+    for (int i = 0; i < n_threads; ++i) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+
+  nav_transform_t all;
+  nav_compose(&chunks[n_threads - 1].prefix, &chunks[n_threads - 1].total, &all);
+  nav_apply(&all, waypoint, location);
+
+  free(threads);
+  free(chunks);
+}
+
+/*
+ * An editable route: an implicit-key treap of opcodes where every node keeps
+ * the composed transform of its whole subtree. Editing, inserting or deleting
+ * an instruction only recomposes the nodes on one root-to-leaf path, so each
+ * edit and each final-position query is O(log n) expected.
+ */
+typedef struct route_node {
+  opcode_t opcode;
+  nav_transform_t self;
+  nav_transform_t total;   // left, then self, then right.
+  unsigned int priority;
+  int size;
+  struct route_node *left;
+  struct route_node *right;
+} route_node_t;
+
+typedef struct route {
+  route_node_t *root;
+  bool correctly;
+  unsigned int seed;
+} route_t;
+
+static int route_size(route_node_t *node) {
+  return node ? node->size : 0;
+}
+
+static void route_update(route_node_t *node) {
+  node->size = 1 + route_size(node->left) + route_size(node->right);
+  node->total = node->self;
+  if (node->left) {
+    nav_compose(&node->left->total, &node->total, &node->total);
+  }
+  if (node->right) {
+    nav_compose(&node->total, &node->right->total, &node->total);
+  }
+}
+
+static route_node_t* route_merge(route_node_t *l, route_node_t *r) {
+  if (!l) return r;
+  if (!r) return l;
+
+  if (l->priority > r->priority) {
+    l->right = route_merge(l->right, r);
+    route_update(l);
+    return l;
+  }
+  r->left = route_merge(l, r->left);
+  route_update(r);
+  return r;
+}
+
+/**
+ * Split node into the first k opcodes and the rest.
+ */
+static void route_split(route_node_t *node, int k,
+                        route_node_t **l, route_node_t **r) {
+  if (!node) {
+    *l = NULL;
+    *r = NULL;
+    return;
+  }
+
+  if (route_size(node->left) < k) {
+    route_split(node->right, k - route_size(node->left) - 1, &node->right, r);
+    *l = node;
+  } else {
+    route_split(node->left, k, l, &node->left);
+    *r = node;
+  }
+  route_update(node);
+}
+
+static route_node_t* route_new_node(route_t *route, opcode_t opcode) {
+  route_node_t *node = calloc(1, sizeof(route_node_t));
+
+  // xorshift; deterministic, and good enough to keep the treap balanced.
+  route->seed ^= route->seed << 13;
+  route->seed ^= route->seed >> 17;
+  route->seed ^= route->seed << 5;
+
+  node->opcode = opcode;
+  node->priority = route->seed;
+  nav_from_opcode(opcode, route->correctly, &node->self);
+  route_update(node);
+  return node;
+}
+
+void route_init(route_t *route,
+                const opcode_t *opcodes,
+                int n_opcodes,
+                bool correctly) {
+  route->root = NULL;
+  route->correctly = correctly;
+  route->seed = 2020;
+
+  for (int i = 0; i < n_opcodes; ++i) {
+    route->root = route_merge(route->root, route_new_node(route, opcodes[i]));
+  }
+}
+
+int route_length(route_t *route) {
+  return route_size(route->root);
+}
+
+/**
+ * Insert opcode so it becomes instruction index, 0 to the route's length.
+ *
+ * Return false, changing nothing, if index is out of range.
+ */
+bool route_insert(route_t *route, int index, opcode_t opcode) {
+  if (index < 0 || index > route_length(route)) {
+    return false;
+  }
+
+  route_node_t *l, *r;
+  route_split(route->root, index, &l, &r);
+  route->root = route_merge(route_merge(l, route_new_node(route, opcode)), r);
+  return true;
+}
+
+/**
+ * Remove instruction index. Return false if there's no such instruction.
+ */
+bool route_delete(route_t *route, int index) {
+  if (index < 0 || index >= route_length(route)) {
+    return false;
+  }
+
+  route_node_t *l, *mid, *r;
+  route_split(route->root, index, &l, &r);
+  route_split(r, 1, &mid, &r);
+  free(mid);
+  route->root = route_merge(l, r);
+  return true;
+}
+
+static void route_set_at(route_node_t *node, int index, opcode_t opcode, bool correctly) {
+  int left = route_size(node->left);
+
+  if (index < left) {
+    route_set_at(node->left, index, opcode, correctly);
+  } else if (index > left) {
+    route_set_at(node->right, index - left - 1, opcode, correctly);
+  } else {
+    node->opcode = opcode;
+    nav_from_opcode(opcode, correctly, &node->self);
+  }
+  route_update(node);
+}
+
+/**
+ * Replace instruction index with opcode. Return false if there's no such
+ * instruction.
+ */
+bool route_set(route_t *route, int index, opcode_t opcode) {
+  if (index < 0 || index >= route_length(route)) {
+    return false;
+  }
+
+  route_set_at(route->root, index, opcode, route->correctly);
+  return true;
+}
+
+/**
+ * Run the whole route from the given starting state.
+ */
+void route_final(route_t *route, coord_t *waypoint, coord_t *location) {
+  if (route->root) {
+    nav_apply(&route->root->total, waypoint, location);
+  }
+}
+
+static void route_free_nodes(route_node_t *node) {
+  if (node) {
+    route_free_nodes(node->left);
+    route_free_nodes(node->right);
+    free(node);
+  }
+}
+
+void route_free(route_t *route) {
+  route_free_nodes(route->root);
+  route->root = NULL;
+}
+
+/*
+ * Compiled routes.
+ *
+ * nav_compile squashes the opcodes down to a dense byte program: runs of
+ * N/S/E/W become one move, runs of L/R become at most one quarter-turn op
+ * (so a turn is a single swap and negate, never a loop), and runs of F add
+ * up. nav_run then executes it with computed gotos (a GCC extension) instead
+ * of a switch, so each op jumps straight to the next op's handler.
+ */
+typedef enum nav_bytecode {
+  OP_HALT,
+  OP_MOVE_WAYPOINT,   // int ns, int ew
+  OP_MOVE_SHIP,       // int ns, int ew
+  OP_TURN_1,          // Clockwise quarter turns.
+  OP_TURN_2,
+  OP_TURN_3,
+  OP_FORWARD          // int times
+} nav_bytecode_t;
+
+typedef struct nav_program {
+  unsigned char *code;
+  int length;
+} nav_program_t;
+
+typedef enum pending {
+  PENDING_NONE,
+  PENDING_MOVE,
+  PENDING_TURN,
+  PENDING_FORWARD
+} pending_t;
+
+static void emit_int(nav_program_t *program, int value) {
+  memcpy(&program->code[program->length], &value, sizeof(int));
+  program->length += sizeof(int);
+}
+
+static void flush_pending(nav_program_t *program, pending_t pending, bool correctly,
+                          int ns, int ew, int turns, int times) {
+  switch (pending) {
+    case PENDING_MOVE:
+      if (ns != 0 || ew != 0) {
+        program->code[program->length++] = correctly ? OP_MOVE_WAYPOINT : OP_MOVE_SHIP;
+        emit_int(program, ns);
+        emit_int(program, ew);
+      }
+      break;
+    case PENDING_TURN:
+      if (turns != 0) {
+        program->code[program->length++] = OP_TURN_1 + turns - 1;
+      }
+      break;
+    case PENDING_FORWARD:
+      if (times != 0) {
+        program->code[program->length++] = OP_FORWARD;
+        emit_int(program, times);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void nav_compile(const opcode_t *opcodes,
+                 int n_opcodes,
+                 bool correctly,
+                 nav_program_t *program) {
+  // Worst case: nothing merges and every op is a move.
+  program->code = malloc(n_opcodes * (1 + 2 * sizeof(int)) + 1);
+  program->length = 0;
+
+  pending_t pending = PENDING_NONE;
+  int ns = 0, ew = 0, turns = 0, times = 0;
+
+  for (int i = 0; i < n_opcodes; ++i) {
+    opcode_t opcode = opcodes[i];
+    pending_t kind;
+
+    switch (opcode.op) {
+      case 'N':
+      case 'S':
+      case 'E':
+      case 'W':
+        kind = PENDING_MOVE;
+        break;
+      case 'L':
+      case 'R':
+        kind = PENDING_TURN;
+        break;
+      case 'F':
+        kind = PENDING_FORWARD;
+        break;
+      default:
+        printf("ugh.\n");
+        exit(-1);
+    }
+
+    if (kind != pending) {
+      flush_pending(program, pending, correctly, ns, ew, turns, times);
+      pending = kind;
+      ns = ew = turns = times = 0;
+    }
+
+    switch (opcode.op) {
+      case 'N': ns += opcode.value; break;
+      case 'S': ns -= opcode.value; break;
+      case 'E': ew += opcode.value; break;
+      case 'W': ew -= opcode.value; break;
+      case 'R': turns = (turns + opcode.value / 90) % 4; break;
+      case 'L': turns = (turns + 4 - (opcode.value / 90) % 4) % 4; break;
+      case 'F': times += opcode.value; break;
+    }
+  }
+
+  flush_pending(program, pending, correctly, ns, ew, turns, times);
+  program->code[program->length++] = OP_HALT;
+}
+
+void nav_run(const nav_program_t *program, coord_t *waypoint, coord_t *location) {
+  static void *dispatch[] = {
+    &&halt,
+    &&move_waypoint,
+    &&move_ship,
+    &&turn_1,
+    &&turn_2,
+    &&turn_3,
+    &&forward
+  };
+
+  const unsigned char *pc = program->code;
+  int wns = waypoint->ns, wew = waypoint->ew;
+  int lns = location->ns, lew = location->ew;
+  int a, b, temp;
+
+#define NEXT() goto *dispatch[*pc++]
+#define OPERAND(x) do { memcpy(&(x), pc, sizeof(int)); pc += sizeof(int); } while (0)
+
+  NEXT();
+
+move_waypoint:
+  OPERAND(a);
+  OPERAND(b);
+  wns += a;
+  wew += b;
+  NEXT();
+
+move_ship:
+  OPERAND(a);
+  OPERAND(b);
+  lns += a;
+  lew += b;
+  NEXT();
+
+turn_1:
+  temp = wns;
+  wns = -wew;
+  wew = temp;
+  NEXT();
+
+turn_2:
+  wns = -wns;
+  wew = -wew;
+  NEXT();
+
+turn_3:
+  temp = wns;
+  wns = wew;
+  wew = -temp;
+  NEXT();
+
+forward:
+  OPERAND(a);
+  lns += wns * a;
+  lew += wew * a;
+  NEXT();
+
+halt:
+#undef OPERAND
+#undef NEXT
+  waypoint->ns = wns;
+  waypoint->ew = wew;
+  location->ns = lns;
+  location->ew = lew;
+}
+
+void nav_program_free(nav_program_t *program) {
+  free(program->code);
+  program->code = NULL;
+  program->length = 0;
+}
+
+/*
+ * One route, many starting states, kept as columns (structure of arrays).
+ *
+ * Each opcode is decoded once and then applied to every start with vector
+ * arithmetic over the columns.
+ * A quarter turn doesn't even touch the data: it swaps the ns and ew column
+ * pointers and negates one of them. So always read the columns back out of
+ * the batch, not from the pointers you put in.
+ */
+typedef struct nav_batch {
+  int n;
+  int *waypoint_ns;
+  int *waypoint_ew;
+  int *location_ns;
+  int *location_ew;
+} nav_batch_t;
+
+// Four lanes at a time with GCC vector extensions, then a scalar tail.
+typedef int v4si __attribute__((vector_size(16)));
+
+static void column_add(int *restrict column, int n, int value) {
+  v4si add = { value, value, value, value };
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    v4si v;
+    memcpy(&v, &column[i], sizeof(v));
+    v += add;
+    memcpy(&column[i], &v, sizeof(v));
+  }
+  for (; i < n; ++i) {
+    column[i] += value;
+  }
+}
+
+static void column_negate(int *restrict column, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    v4si v;
+    memcpy(&v, &column[i], sizeof(v));
+    v = -v;
+    memcpy(&column[i], &v, sizeof(v));
+  }
+  for (; i < n; ++i) {
+    column[i] = -column[i];
+  }
+}
+
+static void column_add_scaled(int *restrict column, const int *restrict other,
+                              int n, int times) {
+  v4si scale = { times, times, times, times };
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    v4si v, w;
+    memcpy(&v, &column[i], sizeof(v));
+    memcpy(&w, &other[i], sizeof(w));
+    v += w * scale;
+    memcpy(&column[i], &v, sizeof(v));
+  }
+  for (; i < n; ++i) {
+    column[i] += other[i] * times;
+  }
+}
+
+void execute_batch(const opcode_t *opcodes, int n_opcodes, nav_batch_t *batch) {
+  int n = batch->n;
+  int *temp;
+
+  for (int i = 0; i < n_opcodes; ++i) {
+    opcode_t opcode = opcodes[i];
+    int turns = 0;
+
+    switch(opcode.op) {
+      case 'N':
+        column_add(batch->waypoint_ns, n, opcode.value);
+        break;
+      case 'S':
+        column_add(batch->waypoint_ns, n, -opcode.value);
+        break;
+      case 'E':
+        column_add(batch->waypoint_ew, n, opcode.value);
+        break;
+      case 'W':
+        column_add(batch->waypoint_ew, n, -opcode.value);
+        break;
+      case 'L':
+        turns = (4 - (opcode.value / 90) % 4) % 4;
+        break;
+      case 'R':
+        turns = (opcode.value / 90) % 4;
+        break;
+      case 'F':
+        column_add_scaled(batch->location_ns, batch->waypoint_ns, n, opcode.value);
+        column_add_scaled(batch->location_ew, batch->waypoint_ew, n, opcode.value);
+        break;
+      default:
+        printf("ugh.\n");
+        exit(-1);
+    }
+
+    // Clockwise: (ns, ew) -> (-ew, ns), or both negated for a half turn.
+    switch (turns) {
+      case 1:
+        temp = batch->waypoint_ns;
+        batch->waypoint_ns = batch->waypoint_ew;
+        batch->waypoint_ew = temp;
+        column_negate(batch->waypoint_ns, n);
+        break;
+      case 2:
+        column_negate(batch->waypoint_ns, n);
+        column_negate(batch->waypoint_ew, n);
+        break;
+      case 3:
+        temp = batch->waypoint_ns;
+        batch->waypoint_ns = batch->waypoint_ew;
+        batch->waypoint_ew = temp;
+        column_negate(batch->waypoint_ew, n);
+        break;
+    }
+  }
+}
+
+/**
+ * Either rule, without a word. execute_wrongly talks too much, so doing it
+ * wrongly goes through the transforms instead.
+ */
+static void execute_quietly(const opcode_t *opcodes,
+                            int n_opcodes,
+                            bool correctly,
+                            coord_t *waypoint,
+                            coord_t *location) {
+  if (correctly) {
+    execute_correctly(opcodes, n_opcodes, waypoint, location);
+    return;
+  }
+
+  nav_transform_t t;
+  for (int i = 0; i < n_opcodes; ++i) {
+    nav_from_opcode(opcodes[i], false, &t);
+    nav_apply(&t, waypoint, location);
+  }
+}
+
+/*
+ * Playback index: the state of the ship at any step of a long route.
+ *
+ * Every interval instructions we keep a checkpoint of where the waypoint and
+ * ship were, so getting to step k is a lookup and at most interval - 1
+ * instructions of replay. Memory is n / interval checkpoints; the default
+ * interval of sqrt(n) balances that against the replay.
+ */
+typedef struct playback {
+  const opcode_t *opcodes;   // Not ours; must outlive the index.
+  int n_opcodes;
+  bool correctly;
+  int interval;
+  int n_checkpoints;
+  coord_t *waypoints;        // Checkpoint c is the state before step c * interval.
+  coord_t *locations;
+} playback_t;
+
+/**
+ * Index a route, starting from waypoint and location. An interval of 0 means
+ * sqrt(n).
+ */
+void playback_init(playback_t *playback,
+                   const opcode_t *opcodes,
+                   int n_opcodes,
+                   bool correctly,
+                   coord_t waypoint,
+                   coord_t location,
+                   int interval) {
+  if (interval <= 0) {
+    interval = 1;
+    while ((long) interval * interval < n_opcodes) {
+      interval++;
+    }
+  }
+
+  playback->opcodes = opcodes;
+  playback->n_opcodes = n_opcodes;
+  playback->correctly = correctly;
+  playback->interval = interval;
+  playback->n_checkpoints = n_opcodes / interval + 1;
+  playback->waypoints = malloc(sizeof(coord_t) * playback->n_checkpoints);
+  playback->locations = malloc(sizeof(coord_t) * playback->n_checkpoints);
+
+  for (int c = 0; c < playback->n_checkpoints; ++c) {
+    if (c > 0) {
+      execute_quietly(opcodes + (c - 1) * interval, interval, correctly,
+                      &waypoint, &location);
+    }
+    playback->waypoints[c] = waypoint;
+    playback->locations[c] = location;
+  }
+}
+
+/**
+ * The waypoint and ship after the first step instructions (0 to n).
+ *
+ * Return false, leaving them alone, if step is out of range.
+ */
+bool playback_seek(const playback_t *playback, int step,
+                   coord_t *waypoint, coord_t *location) {
+  if (step < 0 || step > playback->n_opcodes) {
+    return false;
+  }
+
+  int c = step / playback->interval;
+  *waypoint = playback->waypoints[c];
+  *location = playback->locations[c];
+  execute_quietly(playback->opcodes + c * playback->interval,
+                  step - c * playback->interval, playback->correctly,
+                  waypoint, location);
+  return true;
+}
+
+void playback_free(playback_t *playback) {
+  free(playback->waypoints);
+  free(playback->locations);
+}
+
+/*
+ * Streaming route loader.
+ *
+ * The file is mapped rather than read, and parsed straight out of the
+ * mapping a batch at a time, so there's no length to know up front and no
+ * copy of the whole route in memory. Bad input is reported, not fatal, and a
+ * last line without a newline still counts.
+ */
+typedef struct route_file {
+  input_t input;
+  size_t pos;
+} route_file_t;
+
+/**
+ * Parse up to batch_size opcodes from input, starting at *pos.
+ *
+ * Return how many were read, or -1 on a malformed line (with *pos at it).
+ */
+static int parse_opcodes(const input_t *input, size_t *pos, opcode_t *batch, int batch_size) {
+  int n = 0;
+  int found = 0;
+
+  while (n < batch_size &&
+         (found = input_next_opcode(input, pos, &batch[n].op, &batch[n].value)) == 1) {
+    if (!is_nav_op(batch[n].op)) {
+      found = -1;
+      break;
+    }
+    n++;
+  }
+  return (found == -1) ? -1 : n;
+}
+
+bool route_file_open(const char* filename, route_file_t *file) {
+  file->pos = 0;
+  return input_open(filename, &file->input);
+}
+
+/**
+ * Parse up to batch_size more opcodes into batch.
+ *
+ * Return how many were read, 0 at end of file, or -1 on a malformed line.
+ */
+int route_file_next(route_file_t *file, opcode_t *batch, int batch_size) {
+  int n = parse_opcodes(&file->input, &file->pos, batch, batch_size);
+  if (n < 0) {
+    aoc_warn("wat: bad instruction on line %d\n", line_number(&file->input, file->pos));
+  }
+  return n;
+}
+
+void route_file_close(route_file_t *file) {
+  input_close(&file->input);
+}
+
+/**
+ * Read a whole route file, however long, into *opcodes, growing the array as
+ * it goes. The caller frees it.
+ *
+ * Return the number of instructions, or -1 (with *opcodes NULL) if the file
+ * can't be read or has a bad line.
+ */
+int loadInstructions(const char* filename, opcode_t **opcodes) {
+  route_file_t file;
+  *opcodes = NULL;
+  if (!route_file_open(filename, &file)) {
+    return -1;
+  }
+
+  int capacity = 1024;
+  int n_opcodes = 0;
+  int n;
+  opcode_t *out = malloc(sizeof(opcode_t) * capacity);
+
+  while ((n = route_file_next(&file, out + n_opcodes, capacity - n_opcodes)) > 0) {
+    n_opcodes += n;
+    if (n_opcodes == capacity) {
+      capacity *= 2;
+      out = realloc(out, sizeof(opcode_t) * capacity);
+    }
+  }
+
+  route_file_close(&file);
+  if (n < 0) {
+    free(out);
+    return -1;
+  }
+  *opcodes = out;
+  return n_opcodes;
+}
+
+/**
+ * Run a route file of any length, a batch at a time.
+ *
+ * Return the number of instructions executed, or -1 if the file is bad.
+ */
+long execute_file(const char* filename,
+                  bool correctly,
+                  coord_t *waypoint,
+                  coord_t *location) {
+  const int batch_size = 4096;
+  opcode_t batch[batch_size];
+  route_file_t file;
+  long total = 0;
+  int n;
+
+  if (!route_file_open(filename, &file)) {
+    return -1;
+  }
+
+  while ((n = route_file_next(&file, batch, batch_size)) > 0) {
+    execute_quietly(batch, n, correctly, waypoint, location);
+    total += n;
+  }
+
+  route_file_close(&file);
+  return (n < 0) ? -1 : total;
+}
+
+/**
+ * Run a route file of any length as execute_file does, but parse and run
+ * each chunk while the next is being read (see pipeline.h). Lines aren't
+ * counted on the way, so a bad one is reported by its byte offset.
+ *
+ * Return the number of instructions executed, or -1 if the file is bad.
+ */
+long execute_file_pipelined(const char* filename,
+                            bool correctly,
+                            coord_t *waypoint,
+                            coord_t *location,
+                            bool use_uring,
+                            pipeline_stats_t *stats) {
+  const int batch_size = 4096;
+  opcode_t batch[batch_size];
+  pipeline_t pipe;
+  input_t chunk;
+  long total = 0;
+  int n = 0;
+
+  if (!pipeline_open(&pipe, filename, 0, use_uring)) {
+    return -1;
+  }
+
+  while (n >= 0 && pipeline_next(&pipe, &chunk)) {
+    size_t pos = 0;
+    while ((n = parse_opcodes(&chunk, &pos, batch, batch_size)) > 0) {
+      execute_quietly(batch, n, correctly, waypoint, location);
+      total += n;
+    }
+    if (n < 0) {
+      aoc_warn("wat: bad instruction at byte %zu\n", pipe.stats.bytes - chunk.size + pos);
+    }
+  }
+
+  bool failed = pipe.failed;
+  pipeline_close(&pipe, stats);
+  return (n < 0 || failed) ? -1 : total;
+}
+
 int manhattan_distance(coord_t* coord) {
   return abs(coord->ns) + abs(coord->ew);;;;
 }
 
+/**
+ * Manhattan distance to where the ship ends up: part 1 steering the ship
+ * itself, part 2 steering the waypoint.
+ */
+bool day12_solve(int part, const char *path, char *answer, size_t answer_size) {
+  PROF_SCOPE("day12_solve");
+  coord_t waypoint = (part == 1) ? (coord_t) { 0, 1 } : (coord_t) { 1, 10 };
+  coord_t location = { 0, 0 };
+
+  if (execute_file(path, part != 1, &waypoint, &location) < 0) {
+    return false;
+  }
+  snprintf(answer, answer_size, "%d", manhattan_distance(&location));
+  return true;
+}
+
+#ifndef AOC_LIBRARY
+
 void test_read() {
-  int test_len = 5;
-  opcode_t *opcodes = malloc(sizeof(opcode_t) * test_len);
-  readInstructions("day12_test_data.txt", opcodes, test_len);
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_test_data.txt", &opcodes);
+  assert(n_opcodes == 5);
 
   assert(opcodes[0].op == 'F');
   assert(opcodes[0].value == 10);
@@ -244,23 +1211,45 @@ void test_read() {
 
   assert(opcodes[4].op == 'F');
   assert(opcodes[4].value == 11);
+
+  free(opcodes);
+
+  // A bad line or a missing file is an error, not a short route.
+  char path[] = "/tmp/day12_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  FILE *fp = fdopen(fd, "w");
+  fprintf(fp, "F10\nN3\nQ7\n");
+  fclose(fp);
+  int bad = loadInstructions(path, &opcodes);
+  assert(bad == -1 && opcodes == NULL);
+  unlink(path);
+
+  int missing = loadInstructions("/nonexistent/day12.txt", &opcodes);
+  assert(missing == -1 && opcodes == NULL);
 }
 
 void test_path() {
-  int test_len = 5;
-  opcode_t *opcodes = malloc(sizeof(opcode_t) * test_len);
-  readInstructions("day12_test_data.txt", opcodes, test_len);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_test_data.txt", &opcodes);
+  assert(n_opcodes == 5);
 
-  coord_t *coords = malloc(sizeof(coord_t));
+  coord_t *coords = arena_alloc(&arena, sizeof(coord_t));
   coords->ns = 0;
   coords->ew = 0;
 
-  execute_wrongly(opcodes, test_len, coords);
+  execute_wrongly(opcodes, n_opcodes, coords);
 
   assert(abs(coords->ns) == 8);
   assert(abs(coords->ew) == 17);
   assert(manhattan_distance(coords) == 25);
   printf("yay\n");
+
+  free(opcodes);
+  arena_free(&arena);
 }
 
 void test_rotate() {
@@ -274,23 +1263,22 @@ void test_rotate() {
 }
 
 void part1() {
-  int n_opcodes = 769;
-  opcode_t *opcodes = malloc(sizeof(opcode_t) * n_opcodes);
-  readInstructions("day12_data.txt", opcodes, n_opcodes);
-
-  coord_t *coords = malloc(sizeof(coord_t));
-  coords->ns = 0;
-  coords->ew = 0;
-
-  execute_wrongly(opcodes, n_opcodes, coords);
-
-  printf("Distance = %d\n", manhattan_distance(coords));
+  // Doing it wrongly, the waypoint is just the ship's heading, east.
+  coord_t heading = { 0, 1 };
+  coord_t location = { 0, 0 };
+  if (execute_file("day12_data.txt", false, &heading, &location) < 0) {
+    printf("woe! can't run day12_data.txt\n");
+    return;
+  }
 
-  free(opcodes);
+  printf("Distance = %d\n", manhattan_distance(&location));
 }
 
 void test_rotate_about_left() {
-  coord_t *waypoint = malloc(sizeof(coord_t));
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  coord_t *waypoint = arena_alloc(&arena, sizeof(coord_t));
   waypoint->ew = 3;
   waypoint->ns = 2;
 
@@ -309,10 +1297,15 @@ void test_rotate_about_left() {
   rotate_about_left(waypoint, 90);
   assert(waypoint->ew == 3);
   assert(waypoint->ns == 2);
+
+  arena_free(&arena);
 }
 
 void test_rotate_about_right() {
-  coord_t *waypoint = malloc(sizeof(coord_t));
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  coord_t *waypoint = arena_alloc(&arena, sizeof(coord_t));
   waypoint->ew = 3;
   waypoint->ns = 2;
 
@@ -331,18 +1324,23 @@ void test_rotate_about_right() {
   rotate_about_right(waypoint, 90);
   assert(waypoint->ew == 3);
   assert(waypoint->ns == 2);
+
+  arena_free(&arena);
 }
 
 void test_execute_correctly() {
-  int n_opcodes = 5;
-  opcode_t *opcodes = malloc(sizeof(opcode_t) * n_opcodes);
-  readInstructions("day12_test_data.txt", opcodes, n_opcodes);
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_test_data.txt", &opcodes);
+  assert(n_opcodes == 5);
 
-  coord_t *waypoint = malloc(sizeof(coord_t));
+  coord_t *waypoint = arena_alloc(&arena, sizeof(coord_t));
   waypoint->ew = 10;
   waypoint->ns = 1;
 
-  coord_t *location = malloc(sizeof(coord_t));
+  coord_t *location = arena_alloc(&arena, sizeof(coord_t));
   location->ew = 0;
   location->ns = 0;
 
@@ -352,29 +1350,615 @@ void test_execute_correctly() {
   printf("yay! executes correctly.\n");
 
   free(opcodes);
+  arena_free(&arena);
 }
 
 void part2() {
-  int n_opcodes = 769;
-  opcode_t *opcodes = malloc(sizeof(opcode_t) * n_opcodes);
-  readInstructions("day12_data.txt", opcodes, n_opcodes);
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  if (execute_file("day12_data.txt", true, &waypoint, &location) < 0) {
+    printf("woe! can't run day12_data.txt\n");
+    return;
+  }
 
-  coord_t *waypoint = malloc(sizeof(coord_t));
-  waypoint->ew = 10;
-  waypoint->ns = 1;
+  printf("Distance = %d\n", manhattan_distance(&location));
+}
 
-  coord_t *coords = malloc(sizeof(coord_t));
-  coords->ns = 0;
-  coords->ew = 0;
+void test_execute_scan() {
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_data.txt", &opcodes);
+  assert(n_opcodes > 0);
+
+  // Reference run.
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  execute_correctly(opcodes, n_opcodes, &waypoint, &location);
+
+  for (int threads = 1; threads <= 8; ++threads) {
+    coord_t scan_waypoint = { 1, 10 };
+    coord_t scan_location = { 0, 0 };
+    execute_scan(opcodes, n_opcodes, true, &scan_waypoint, &scan_location,
+                 NULL, NULL, threads);
+    assert(scan_waypoint.ns == waypoint.ns && scan_waypoint.ew == waypoint.ew);
+    assert(scan_location.ns == location.ns && scan_location.ew == location.ew);
+  }
+
+  // Every intermediate state should match a sequential run of that prefix.
+  coord_t *waypoints = malloc(sizeof(coord_t) * n_opcodes);
+  coord_t *locations = malloc(sizeof(coord_t) * n_opcodes);
+  coord_t scan_waypoint = { 1, 10 };
+  coord_t scan_location = { 0, 0 };
+  execute_scan(opcodes, n_opcodes, true, &scan_waypoint, &scan_location,
+               waypoints, locations, 4);
+
+  for (int i = 0; i < n_opcodes; i += 97) {
+    coord_t w = { 1, 10 };
+    coord_t l = { 0, 0 };
+    execute_correctly(opcodes, i + 1, &w, &l);
+    assert(waypoints[i].ns == w.ns && waypoints[i].ew == w.ew);
+    assert(locations[i].ns == l.ns && locations[i].ew == l.ew);
+  }
+  assert(manhattan_distance(&locations[n_opcodes - 1]) == manhattan_distance(&location));
+
+  // Doing it wrongly: the "waypoint" is a heading that starts out east.
+  coord_t heading = { 0, 1 };
+  coord_t ship = { 0, 0 };
+  free(opcodes);
+  n_opcodes = loadInstructions("day12_test_data.txt", &opcodes);
+  assert(n_opcodes == 5);
+  execute_scan(opcodes, n_opcodes, false, &heading, &ship, NULL, NULL, 2);
+  assert(ship.ns == -8 && ship.ew == 17);
+
+  printf("yay! scan agrees. Distance = %d\n", manhattan_distance(&location));
+
+  free(waypoints);
+  free(locations);
+  free(opcodes);
+}
+
+/**
+ * Edit, insert and delete against a plain array that we rerun every time.
+ */
+void test_route_edits() {
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_data.txt", &opcodes);
+  assert(n_opcodes > 0);
+  // Room for the inserts to outrun the deletes.
+  opcodes = realloc(opcodes, sizeof(opcode_t) * (n_opcodes + 100));
+
+  route_t route;
+  route_init(&route, opcodes, n_opcodes, true);
+
+  const char *ops = "NSEWLRF";
+  unsigned int seed = 12;
+
+  for (int round = 0; round < 300; ++round) {
+    seed = seed * 1103515245 + 12345;
+    int index = (seed >> 8) % n_opcodes;
+    opcode_t opcode;
+    opcode.op = ops[(seed >> 4) % 7];
+    opcode.value = (opcode.op == 'L' || opcode.op == 'R') ? 90 * (1 + (seed >> 20) % 3) : (seed >> 16) % 50;
+
+    bool ok = false;
+    switch (round % 3) {
+      case 0:
+        ok = route_set(&route, index, opcode);
+        opcodes[index] = opcode;
+        break;
+      case 1:
+        ok = route_insert(&route, index, opcode);
+        memmove(&opcodes[index + 1], &opcodes[index], sizeof(opcode_t) * (n_opcodes - index));
+        opcodes[index] = opcode;
+        n_opcodes++;
+        break;
+      case 2:
+        ok = route_delete(&route, index);
+        memmove(&opcodes[index], &opcodes[index + 1], sizeof(opcode_t) * (n_opcodes - index - 1));
+        n_opcodes--;
+        break;
+    }
+    assert(ok);
+    assert(route_length(&route) == n_opcodes);
+
+    coord_t waypoint = { 1, 10 };
+    coord_t location = { 0, 0 };
+    execute_correctly(opcodes, n_opcodes, &waypoint, &location);
+
+    coord_t route_waypoint = { 1, 10 };
+    coord_t route_location = { 0, 0 };
+    route_final(&route, &route_waypoint, &route_location);
+
+    assert(route_waypoint.ns == waypoint.ns && route_waypoint.ew == waypoint.ew);
+    assert(route_location.ns == location.ns && route_location.ew == location.ew);
+  }
+  printf("yay! route edits agree.\n");
+
+  opcode_t north = { 'N', 1 };
+  bool set_past_end = route_set(&route, n_opcodes, north);
+  bool set_negative = route_set(&route, -1, north);
+  bool insert_past_end = route_insert(&route, n_opcodes + 1, north);
+  bool delete_past_end = route_delete(&route, n_opcodes);
+  assert(!set_past_end && !set_negative && !insert_past_end && !delete_past_end);
+  assert(route_length(&route) == n_opcodes);
+  printf("yay! route edits out of range fail.\n");
+
+  route_free(&route);
+  free(opcodes);
+}
+
+void test_compiled() {
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_data.txt", &opcodes);
+  assert(n_opcodes > 0);
+
+  nav_program_t program;
+  nav_compile(opcodes, n_opcodes, true, &program);
+
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  execute_correctly(opcodes, n_opcodes, &waypoint, &location);
+
+  coord_t run_waypoint = { 1, 10 };
+  coord_t run_location = { 0, 0 };
+  nav_run(&program, &run_waypoint, &run_location);
+
+  assert(run_waypoint.ns == waypoint.ns && run_waypoint.ew == waypoint.ew);
+  assert(run_location.ns == location.ns && run_location.ew == location.ew);
+  printf("compiled %d opcodes to %d bytes\n", n_opcodes, program.length);
+  nav_program_free(&program);
+
+  // Doing it wrongly, the waypoint is just the ship's heading.
+  nav_compile(opcodes, n_opcodes, false, &program);
+  coord_t heading = { 0, 1 };
+  coord_t ship = { 0, 0 };
+  nav_run(&program, &heading, &ship);
 
-  execute_correctly(opcodes, n_opcodes, waypoint, coords);
+  coord_t scan_heading = { 0, 1 };
+  coord_t scan_ship = { 0, 0 };
+  execute_scan(opcodes, n_opcodes, false, &scan_heading, &scan_ship, NULL, NULL, 1);
+  assert(ship.ns == scan_ship.ns && ship.ew == scan_ship.ew);
+  nav_program_free(&program);
 
-  printf("Distance = %d\n", manhattan_distance(coords));
+  free(opcodes);
+}
+
+static double seconds_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * How much faster is the compiled route than the switch loop?
+ */
+void bench_compiled() {
+  int reps = 20000;
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_data.txt", &opcodes);
+  assert(n_opcodes > 0);
+
+  struct timespec start;
+  long check = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < reps; ++i) {
+    coord_t waypoint = { 1, 10 };
+    coord_t location = { 0, 0 };
+    execute_correctly(opcodes, n_opcodes, &waypoint, &location);
+    check += manhattan_distance(&location);
+  }
+  double switch_secs = seconds_since(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  nav_program_t program;
+  nav_compile(opcodes, n_opcodes, true, &program);
+  for (int i = 0; i < reps; ++i) {
+    coord_t waypoint = { 1, 10 };
+    coord_t location = { 0, 0 };
+    nav_run(&program, &waypoint, &location);
+    check -= manhattan_distance(&location);
+  }
+  double compiled_secs = seconds_since(&start);
+
+  assert(check == 0);
+
+  double n = (double) n_opcodes * reps;
+  printf("switch:   %.2f ns/instruction\n", switch_secs * 1e9 / n);
+  printf("compiled: %.2f ns/instruction (%.1fx)\n",
+         compiled_secs * 1e9 / n, switch_secs / compiled_secs);
+
+  nav_program_free(&program);
+  free(opcodes);
+}
 
+void test_batch() {
+  int n = 1000;
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_data.txt", &opcodes);
+  assert(n_opcodes > 0);
+
+  nav_batch_t batch;
+  batch.n = n;
+  batch.waypoint_ns = malloc(sizeof(int) * n);
+  batch.waypoint_ew = malloc(sizeof(int) * n);
+  batch.location_ns = calloc(n, sizeof(int));
+  batch.location_ew = calloc(n, sizeof(int));
+
+  for (int i = 0; i < n; ++i) {
+    batch.waypoint_ns[i] = i % 21 - 10;
+    batch.waypoint_ew[i] = i / 21 - 20;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  execute_batch(opcodes, n_opcodes, &batch);
+  double batch_secs = seconds_since(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < n; ++i) {
+    coord_t waypoint = { i % 21 - 10, i / 21 - 20 };
+    coord_t location = { 0, 0 };
+    execute_correctly(opcodes, n_opcodes, &waypoint, &location);
+
+    assert(batch.waypoint_ns[i] == waypoint.ns && batch.waypoint_ew[i] == waypoint.ew);
+    assert(batch.location_ns[i] == location.ns && batch.location_ew[i] == location.ew);
+  }
+  double one_by_one_secs = seconds_since(&start);
+
+  // The default start, (1, 10), is i = 641.
+  coord_t location = { batch.location_ns[641], batch.location_ew[641] };
+  assert(manhattan_distance(&location) == 106860);
+
+  printf("batch of %d starts: %.3f ms, one at a time: %.3f ms\n",
+         n, batch_secs * 1e3, one_by_one_secs * 1e3);
+
+  free(batch.waypoint_ns);
+  free(batch.waypoint_ew);
+  free(batch.location_ns);
+  free(batch.location_ew);
   free(opcodes);
 }
 
+/**
+ * Seeking anywhere should match running that prefix from scratch, whatever
+ * the checkpoint interval.
+ */
+void test_playback() {
+  opcode_t *opcodes;
+  int n_opcodes = loadInstructions("day12_data.txt", &opcodes);
+  assert(n_opcodes > 0);
+
+  int intervals[] = { 0, 1, 7, 64, n_opcodes, 5000 };
+  for (int i = 0; i < (int) (sizeof(intervals) / sizeof(intervals[0])); ++i) {
+    playback_t playback;
+    playback_init(&playback, opcodes, n_opcodes, true,
+                  (coord_t) { 1, 10 }, (coord_t) { 0, 0 }, intervals[i]);
+
+    for (int step = 0; step <= n_opcodes; step += 13) {
+      coord_t w = { 1, 10 };
+      coord_t l = { 0, 0 };
+      execute_correctly(opcodes, step, &w, &l);
+
+      coord_t waypoint, location;
+      bool ok = playback_seek(&playback, step, &waypoint, &location);
+      assert(ok);
+      assert(waypoint.ns == w.ns && waypoint.ew == w.ew);
+      assert(location.ns == l.ns && location.ew == l.ew);
+    }
+
+    coord_t waypoint, location;
+    bool ok = playback_seek(&playback, n_opcodes, &waypoint, &location);
+    assert(ok);
+    assert(manhattan_distance(&location) == 106860);
+
+    // Nothing before the start or past the end.
+    coord_t untouched = { 12, 34 };
+    waypoint = location = untouched;
+    bool before = playback_seek(&playback, -1, &waypoint, &location);
+    bool past = playback_seek(&playback, n_opcodes + 1, &waypoint, &location);
+    bool far_past = playback_seek(&playback, n_opcodes + 100 * playback.interval,
+                                  &waypoint, &location);
+    assert(!before && !past && !far_past);
+    assert(location.ns == untouched.ns && location.ew == untouched.ew);
+    playback_free(&playback);
+  }
+
+  // Doing it wrongly: the "waypoint" is a heading that starts out east.
+  playback_t playback;
+  playback_init(&playback, opcodes, n_opcodes, false,
+                (coord_t) { 0, 1 }, (coord_t) { 0, 0 }, 0);
+  assert(playback.interval == 28 && playback.n_checkpoints == 28);
+
+  coord_t heading, ship;
+  bool ok = playback_seek(&playback, n_opcodes, &heading, &ship);
+  assert(ok);
+  assert(manhattan_distance(&ship) == 1457);
+  ok = playback_seek(&playback, 0, &heading, &ship);
+  assert(ok);
+  assert(heading.ns == 0 && heading.ew == 1 && ship.ns == 0 && ship.ew == 0);
+  playback_free(&playback);
+
+  printf("yay! playback seeks.\n");
+  free(opcodes);
+}
+
+void test_execute_file() {
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  long n = execute_file("day12_data.txt", true, &waypoint, &location);
+  assert(n == 769);
+  assert(manhattan_distance(&location) == 106860);
+
+  // No trailing newline on the last instruction.
+  char path[] = "/tmp/day12_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  const char *route = "F10\nN3\nF7\nR90\nF11";
+  ssize_t written = write(fd, route, strlen(route));
+  assert(written == (ssize_t) strlen(route));
+  close(fd);
+
+  coord_t heading = { 0, 1 };
+  coord_t ship = { 0, 0 };
+  n = execute_file(path, false, &heading, &ship);
+  assert(n == 5);
+  assert(manhattan_distance(&ship) == 25);
+
+  waypoint = (coord_t) { 1, 10 };
+  location = (coord_t) { 0, 0 };
+  n = execute_file(path, true, &waypoint, &location);
+  assert(n == 5);
+  assert(manhattan_distance(&location) == 286);
+  unlink(path);
+
+  n = execute_file("day11_data.txt", true, &waypoint, &location);
+  assert(n == -1);
+  printf("yay! streams files.\n");
+}
+
+/*
+ * Benchmarks: a long random route, run from the usual starting waypoint.
+ *
+ * A random walk drifts without bound, and the ship's coordinates are ints,
+ * so the route is steered as it's made: any instruction that would take
+ * the waypoint past 1000 or the ship past 10^8 on either axis turns the
+ * waypoint around (R180) instead, and the next moves head back.
+ */
+typedef struct route_bench {
+  opcode_t *opcodes;
+  int size;
+} route_bench_t;
+
+void* setup_route(long size, uint64_t seed) {
+  const char *ops = "NSEWLRF";
+  const int waypoint_limit = 1000;
+  const int ship_limit = 100000000;
+  route_bench_t *bench = malloc(sizeof(route_bench_t));
+  bench->opcodes = malloc(sizeof(opcode_t) * size);
+  bench->size = (int) size;
+
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  for (long i = 0; i < size; ++i) {
+    opcode_t *opcode = &bench->opcodes[i];
+    opcode->op = ops[bench_random(&seed) % 7];
+    if (opcode->op == 'L' || opcode->op == 'R') {
+      opcode->value = 90 * (1 + bench_random(&seed) % 3);
+    } else {
+      opcode->value = 1 + bench_random(&seed) % 100;
+    }
+
+    coord_t w = waypoint;
+    coord_t l = location;
+    execute_correctly(opcode, 1, &w, &l);
+    if (abs(w.ns) > waypoint_limit || abs(w.ew) > waypoint_limit ||
+        abs(l.ns) > ship_limit || abs(l.ew) > ship_limit) {
+      opcode->op = 'R';
+      opcode->value = 180;
+      w = waypoint;
+      l = location;
+      execute_correctly(opcode, 1, &w, &l);
+    }
+    waypoint = w;
+    location = l;
+  }
+  return bench;
+}
+
+void run_route(void *state) {
+  route_bench_t *bench = state;
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  execute_correctly(bench->opcodes, bench->size, &waypoint, &location);
+
+  // Keep the result alive.
+  volatile int distance = manhattan_distance(&location);
+  (void) distance;
+}
+
+void teardown_route(void *state) {
+  route_bench_t *bench = state;
+  free(bench->opcodes);
+  free(bench);
+}
+
+/**
+ * Write a route out as a file, one instruction per line.
+ */
+static void write_route(const char *path, const opcode_t *opcodes, long n) {
+  FILE *fp = fopen(path, "w");
+  assert(fp != NULL);
+  for (long i = 0; i < n; ++i) {
+    fprintf(fp, "%c%d\n", opcodes[i].op, opcodes[i].value);
+  }
+  fclose(fp);
+}
+
+void test_pipeline() {
+  char path[] = "/tmp/day12_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  const char *route = "F10\nN3\nF7\nR90\nF11";
+  ssize_t written = write(fd, route, strlen(route));
+  assert(written == (ssize_t) strlen(route));
+  close(fd);
+
+  for (int uring = 0; uring < 2; ++uring) {
+    // Tiny chunks: every one but the last should end at a newline, and
+    // together they should be the whole file.
+    pipeline_t pipe;
+    input_t chunk;
+    char whole[64] = "";
+    bool opened = pipeline_open(&pipe, path, 5, uring);
+    assert(opened);
+    while (pipeline_next(&pipe, &chunk)) {
+      assert(chunk.size > 0);
+      strncat(whole, chunk.data, chunk.size);
+      assert(chunk.data[chunk.size - 1] == '\n' || strlen(whole) == strlen(route));
+    }
+    assert(!pipe.failed);
+    pipeline_close(&pipe, NULL);
+    assert(strcmp(whole, route) == 0);
+
+    coord_t waypoint = { 1, 10 };
+    coord_t location = { 0, 0 };
+    long n = execute_file_pipelined("day12_data.txt", true, &waypoint, &location, uring, NULL);
+    assert(n == 769);
+    assert(manhattan_distance(&location) == 106860);
+
+    waypoint = (coord_t) { 1, 10 };
+    location = (coord_t) { 0, 0 };
+    n = execute_file_pipelined(path, true, &waypoint, &location, uring, NULL);
+    assert(n == 5);
+    assert(manhattan_distance(&location) == 286);
+
+    n = execute_file_pipelined("day11_data.txt", true, &waypoint, &location, uring, NULL);
+    assert(n == -1);
+  }
+
+  // A line longer than a chunk can carry.
+  fd = open(path, O_WRONLY | O_TRUNC);
+  assert(fd >= 0);
+  for (int i = 0; i < PIPELINE_MAX_LINE + 10; ++i) {
+    written = write(fd, "9", 1);
+    assert(written == 1);
+  }
+  close(fd);
+  pipeline_t pipe;
+  input_t chunk;
+  bool opened = pipeline_open(&pipe, path, 1024, false);
+  assert(opened);
+  while (pipeline_next(&pipe, &chunk)) {
+  }
+  assert(pipe.failed);
+  pipeline_close(&pipe, NULL);
+
+  // Several megabytes, so plenty of chunks, against the mapped loader.
+  route_bench_t *bench = setup_route(1000000, 12);
+  write_route(path, bench->opcodes, bench->size);
+  for (int uring = 0; uring < 2; ++uring) {
+    for (int correctly = 0; correctly < 2; ++correctly) {
+      coord_t w1 = correctly ? (coord_t) { 1, 10 } : (coord_t) { 0, 1 };
+      coord_t l1 = { 0, 0 };
+      coord_t w2 = w1;
+      coord_t l2 = l1;
+      pipeline_stats_t stats;
+      long mapped = execute_file(path, correctly, &w1, &l1);
+      long piped = execute_file_pipelined(path, correctly, &w2, &l2, uring, &stats);
+      assert(mapped == bench->size && piped == bench->size);
+      assert(memcmp(&w1, &w2, sizeof(coord_t)) == 0);
+      assert(memcmp(&l1, &l2, sizeof(coord_t)) == 0);
+      assert(stats.chunks > 1);
+    }
+  }
+  teardown_route(bench);
+  unlink(path);
+
+  printf("yay! pipelines files.\n");
+}
+
+/*
+ * The same route from a file, read cold: through the mapping, and through
+ * the pipeline on each backend, which also reports how well it overlapped.
+ */
+typedef struct route_file_bench {
+  char path[32];
+  long size;
+  bool use_uring;
+  pipeline_stats_t total;
+  int runs;
+} route_file_bench_t;
+
+static void* setup_route_file(long size, uint64_t seed, bool use_uring) {
+  route_file_bench_t *bench = calloc(1, sizeof(route_file_bench_t));
+  strcpy(bench->path, "/tmp/day12_XXXXXX");
+  close(mkstemp(bench->path));
+  bench->size = size;
+  bench->use_uring = use_uring;
+
+  route_bench_t *route = setup_route(size, seed);
+  write_route(bench->path, route->opcodes, size);
+  teardown_route(route);
+  return bench;
+}
+
+void* setup_route_file_uring(long size, uint64_t seed) {
+  return setup_route_file(size, seed, true);
+}
+
+void* setup_route_file_thread(long size, uint64_t seed) {
+  return setup_route_file(size, seed, false);
+}
+
+void run_route_file_mapped(void *state) {
+  route_file_bench_t *bench = state;
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  pipeline_drop_cache(bench->path);
+  long n = execute_file(bench->path, true, &waypoint, &location);
+  assert(n == bench->size);
+}
+
+void run_route_file(void *state) {
+  route_file_bench_t *bench = state;
+  coord_t waypoint = { 1, 10 };
+  coord_t location = { 0, 0 };
+  pipeline_stats_t stats;
+  pipeline_drop_cache(bench->path);
+  long n = execute_file_pipelined(bench->path, true, &waypoint, &location,
+                                  bench->use_uring, &stats);
+  assert(n == bench->size);
+  pipeline_stats_add(&bench->total, &stats);
+  bench->runs++;
+}
+
+void annotate_route_file(void *state, char *out, size_t size) {
+  route_file_bench_t *bench = state;
+  pipeline_annotate(bench->path, &bench->total, bench->runs, out, size);
+}
+
+void teardown_route_file(void *state) {
+  route_file_bench_t *bench = state;
+  unlink(bench->path);
+  free(bench);
+}
+
+// Eight bytes an opcode: 10^8 is 800 MB, 10^9 would be 8 GB.
+const bench_kernel_t kernels[] = {
+  { "day12", "execute_correctly", 8, setup_route, run_route, teardown_route, NULL },
+  { "day12", "execute_file", 7, setup_route_file_thread, run_route_file_mapped,
+    teardown_route_file, NULL },
+  { "day12", "execute_file_pipelined/io_uring", 7, setup_route_file_uring, run_route_file,
+    teardown_route_file, annotate_route_file },
+  { "day12", "execute_file_pipelined/thread", 7, setup_route_file_thread, run_route_file,
+    teardown_route_file, annotate_route_file },
+};
+
 int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return bench_main(argc, argv, kernels, sizeof(kernels) / sizeof(kernels[0]));
+  }
+
   test_read();
   test_rotate();
   test_path();
@@ -384,6 +1968,16 @@ int main(int argc, char** argv) {
   test_rotate_about_left();
   test_rotate_about_right();
   test_execute_correctly();
+  test_execute_scan();
+  test_route_edits();
+  test_compiled();
+  bench_compiled();
+  test_batch();
+  test_execute_file();
+  test_pipeline();
+  test_playback();
 
   part2();
 }
+
+#endif
@@ -3,6 +3,18 @@
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "bench.h"
+#include "arena.h"
+#include "aoc.h"
+#include "prof.h"
 
 typedef struct bus {
   int id;
@@ -60,6 +72,7 @@ void find_bus(long earliest_departure_time,
          bus_t buses[],
          int n_buses,
          bus_t *best_bus) {
+  PROF_SCOPE("find_bus");
 
   best_bus->id = -1;
   best_bus->best_time = LONG_MAX;
@@ -86,18 +99,916 @@ void find_bus(long earliest_departure_time,
   }
 }
 
+/*
+ * Part 2: the earliest time t where every listed bus i leaves at t + i.
+ *
+ * That's a system of congruences t = -i (mod id), solved by merging one
+ * bus at a time into a running (t mod m). Bus IDs don't have to be coprime;
+ * a merge just fails if two of them disagree. The running modulus stays in
+ * a 128-bit integer for as long as it fits, and moves to a bignum after
+ * that, so schedules with hundreds of buses are fine.
+ */
+typedef struct bignum {
+  uint32_t *limbs;    // Little-endian, base 2^32.
+  int n;
+  int cap;
+} bignum_t;
+
+// Merges are timed one by one and binned by how wide the modulus was going
+// in, 64 bits to a bucket; the last bucket takes everything wider.
+#define CRT_BUCKET_BITS 64
+#define CRT_BUCKETS 32
+
+typedef struct crt_bucket {
+  int merges;
+  double secs;
+} crt_bucket_t;
+
+typedef struct crt_stats {
+  int steps_128;
+  int steps_big;
+  double secs_128;
+  double secs_big;
+  double secs_format;
+  crt_bucket_t by_width[CRT_BUCKETS];
+} crt_stats_t;
+
+static void big_init(bignum_t *b, unsigned __int128 value) {
+  b->cap = 8;
+  b->limbs = malloc(sizeof(uint32_t) * b->cap);
+  b->n = 0;
+  while (value) {
+    b->limbs[b->n++] = (uint32_t) value;
+    value >>= 32;
+  }
+}
+
+static int big_bits(const bignum_t *b) {
+  return b->n ? 32 * b->n - __builtin_clz(b->limbs[b->n - 1]) : 0;
+}
+
+static void big_reserve(bignum_t *b, int n) {
+  if (n > b->cap) {
+    b->cap = n * 2;
+    b->limbs = realloc(b->limbs, sizeof(uint32_t) * b->cap);
+  }
+}
+
+static uint32_t big_mod(const bignum_t *b, uint32_t m) {
+  uint64_t r = 0;
+  for (int i = b->n - 1; i >= 0; --i) {
+    r = ((r << 32) | b->limbs[i]) % m;
+  }
+  return (uint32_t) r;
+}
+
+/**
+ * a += b * k. Pass a == b to scale in place by k + 1.
+ */
+static void big_add_mul(bignum_t *a, const bignum_t *b, uint32_t k) {
+  int n = (a->n > b->n ? a->n : b->n) + 1;
+  big_reserve(a, n);
+  for (int i = a->n; i < n; ++i) {
+    a->limbs[i] = 0;
+  }
+
+  uint64_t carry = 0;
+  int bn = b->n;
+  for (int i = 0; i < n; ++i) {
+    uint64_t bi = (i < bn) ? b->limbs[i] : 0;
+    uint64_t sum = (uint64_t) a->limbs[i] + bi * k + carry;
+    a->limbs[i] = (uint32_t) sum;
+    carry = sum >> 32;
+  }
+
+  a->n = n;
+  while (a->n > 0 && a->limbs[a->n - 1] == 0) {
+    a->n--;
+  }
+}
+
+static void big_mul(bignum_t *b, uint32_t k) {
+  uint64_t carry = 0;
+  for (int i = 0; i < b->n; ++i) {
+    uint64_t prod = (uint64_t) b->limbs[i] * k + carry;
+    b->limbs[i] = (uint32_t) prod;
+    carry = prod >> 32;
+  }
+  if (carry) {
+    big_reserve(b, b->n + 1);
+    b->limbs[b->n++] = (uint32_t) carry;
+  }
+}
+
+/**
+ * Write b out in decimal, as much of it as fits. Destroys b.
+ *
+ * Return the number of digits, like snprintf: if that's out_size or more,
+ * out was cut short.
+ */
+static size_t big_to_decimal(bignum_t *b, char *out, size_t out_size) {
+  // Peel off nine digits at a time.
+  int n_chunks = 0;
+  uint32_t *chunks = malloc(sizeof(uint32_t) * (b->n * 10 / 9 + 2));
+
+  do {
+    uint64_t r = 0;
+    for (int i = b->n - 1; i >= 0; --i) {
+      uint64_t cur = (r << 32) | b->limbs[i];
+      b->limbs[i] = (uint32_t) (cur / 1000000000);
+      r = cur % 1000000000;
+    }
+    chunks[n_chunks++] = (uint32_t) r;
+    while (b->n > 0 && b->limbs[b->n - 1] == 0) {
+      b->n--;
+    }
+  } while (b->n > 0);
+
+  size_t digits = snprintf(out, out_size, "%u", chunks[n_chunks - 1]);
+  size_t len = digits;
+  for (int i = n_chunks - 2; i >= 0 && len < out_size; --i) {
+    len += snprintf(out + len, out_size - len, "%09u", chunks[i]);
+  }
+
+  free(chunks);
+  return digits + 9 * (size_t) (n_chunks - 1);
+}
+
+static long mod_inverse(long a, long m) {
+  long old_r = a, r = m;
+  long old_s = 1, s = 0;
+  while (r != 0) {
+    long q = old_r / r;
+    long tmp = r; r = old_r - q * r; old_r = tmp;
+    tmp = s; s = old_s - q * s; old_s = tmp;
+  }
+  // old_r is gcd(a, m), which the caller has made 1.
+  return ((old_s % m) + m) % m;
+}
+
+static long gcd(long a, long b) {
+  while (b) {
+    long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static double seconds_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int u128_bits(unsigned __int128 x) {
+  uint64_t hi = (uint64_t) (x >> 64);
+  uint64_t lo = (uint64_t) x;
+  return hi ? 128 - __builtin_clzll(hi) : (lo ? 64 - __builtin_clzll(lo) : 0);
+}
+
+/**
+ * Count one merge, into a modulus bits wide, that began at start.
+ */
+static void crt_record(crt_stats_t *stats, int bits, struct timespec *start) {
+  int bucket = bits / CRT_BUCKET_BITS;
+  if (bucket >= CRT_BUCKETS) {
+    bucket = CRT_BUCKETS - 1;
+  }
+  stats->by_width[bucket].merges++;
+  stats->by_width[bucket].secs += seconds_since(start);
+}
+
+/**
+ * Given t = a (mod m) so far, and t = r (mod id) for the next bus, find the
+ * step k so that a + m * k satisfies both. Return the new modulus factor
+ * id / gcd, or 0 if the two can't both hold.
+ */
+static long crt_step(long a_mod_id, long m_mod_id, long r, long id, long *k) {
+  long g = gcd(m_mod_id, id);
+  long diff = ((r - a_mod_id) % id + id) % id;
+  if (diff % g != 0) {
+    return 0;
+  }
+  long id_g = id / g;
+  *k = (long) ((__int128) (diff / g) * mod_inverse((m_mod_id / g) % id_g, id_g) % id_g);
+  return id_g;
+}
+
+/**
+ * Write the earliest time where bus i leaves offsets[i] minutes after it into
+ * out, in decimal. With no offsets, each bus's offset is its list position.
+ *
+ * Return false if the buses can never line up, or if the time has too many
+ * digits for out_size.
+ */
+bool earliest_alignment_at(const bus_t *buses,
+                           const int *offsets,
+                           int n_buses,
+                           char *out,
+                           size_t out_size,
+                           crt_stats_t *stats) {
+  memset(stats, 0, sizeof(crt_stats_t));
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // Stay in 128 bits while the modulus has room for another 32-bit factor.
+  unsigned __int128 a = 0;
+  unsigned __int128 m = 1;
+  const unsigned __int128 limit = ((unsigned __int128) 1) << 95;
+
+  int i = 0;
+  for (; i < n_buses && m < limit; ++i) {
+    long id = buses[i].id;
+    if (id == -1) {
+      continue;
+    }
+
+    struct timespec merge_start;
+    clock_gettime(CLOCK_MONOTONIC, &merge_start);
+    int bits = u128_bits(m);
+
+    long offset = offsets ? offsets[i] : i;
+    long r = ((-offset) % id + id) % id;
+    long k;
+    long factor = crt_step((long) (a % id), (long) (m % id), r, id, &k);
+    if (factor == 0) {
+      return false;
+    }
+
+    a += m * k;
+    m *= factor;
+    stats->steps_128++;
+    crt_record(stats, bits, &merge_start);
+  }
+  stats->secs_128 = seconds_since(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bignum_t big_a, big_m;
+  big_init(&big_a, a);
+  big_init(&big_m, m);
+
+  bool ok = true;
+  for (; i < n_buses && ok; ++i) {
+    long id = buses[i].id;
+    if (id == -1) {
+      continue;
+    }
+
+    struct timespec merge_start;
+    clock_gettime(CLOCK_MONOTONIC, &merge_start);
+    int bits = big_bits(&big_m);
+
+    long offset = offsets ? offsets[i] : i;
+    long r = ((-offset) % id + id) % id;
+    long k;
+    long factor = crt_step(big_mod(&big_a, id), big_mod(&big_m, id), r, id, &k);
+    if (factor == 0) {
+      ok = false;
+      break;
+    }
+
+    big_add_mul(&big_a, &big_m, k);
+    big_mul(&big_m, factor);
+    stats->steps_big++;
+    crt_record(stats, bits, &merge_start);
+  }
+  stats->secs_big = seconds_since(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (ok && big_to_decimal(&big_a, out, out_size) >= out_size) {
+    ok = false;
+  }
+  stats->secs_format = seconds_since(&start);
+
+  free(big_a.limbs);
+  free(big_m.limbs);
+  return ok;
+}
+
+bool earliest_alignment(const bus_t *buses,
+                        int n_buses,
+                        char *out,
+                        size_t out_size,
+                        crt_stats_t *stats) {
+  return earliest_alignment_at(buses, NULL, n_buses, out, out_size, stats);
+}
+
+void print_crt_stats(crt_stats_t *stats) {
+  printf("  128-bit: %d steps in %.6fs\n", stats->steps_128, stats->secs_128);
+  printf("  bignum:  %d steps in %.6fs\n", stats->steps_big, stats->secs_big);
+  printf("  decimal: %.6fs\n", stats->secs_format);
+
+  for (int b = 0; b < CRT_BUCKETS; ++b) {
+    const crt_bucket_t *bucket = &stats->by_width[b];
+    if (bucket->merges == 0) {
+      continue;
+    }
+    if (b == CRT_BUCKETS - 1) {
+      printf("  %4d+     bits: %3d merges, %.3f us each\n", b * CRT_BUCKET_BITS,
+             bucket->merges, bucket->secs * 1e6 / bucket->merges);
+    } else {
+      printf("  %4d-%-4d bits: %3d merges, %.3f us each\n", b * CRT_BUCKET_BITS,
+             (b + 1) * CRT_BUCKET_BITS - 1, bucket->merges, bucket->secs * 1e6 / bucket->merges);
+    }
+  }
+}
+
+/**
+ * Merges counted across every width bucket.
+ */
+int crt_merges(const crt_stats_t *stats) {
+  int merges = 0;
+  for (int b = 0; b < CRT_BUCKETS; ++b) {
+    merges += stats->by_width[b].merges;
+  }
+  return merges;
+}
+
+/*
+ * Departure board: answer lots of "which bus is next after t?" queries
+ * against one fixed list, without any division instructions.
+ *
+ * Each bus gets a precomputed 64-bit reciprocal (Lemire's fastmod), so
+ * t mod id is a handful of multiplies. Queries go four at a time through GCC
+ * vector extensions, each lane keeping its own best bus. Query times and bus
+ * IDs are 32-bit, which covers any sane timetable, so every multiply can be
+ * written as 32x32->64-bit lane products. AVX2 does four of those in one
+ * vpmuludq, but it has no 64x64 lane multiply (that's AVX-512DQ's vpmullq),
+ * and GCC won't find vpmuludq in the masked form on its own. So with -mavx2
+ * or -march=native, mul32 asks for it by name; without, the plain 64-bit
+ * lane multiplies are left to the compiler.
+ */
+typedef uint64_t v4du __attribute__((vector_size(32)));
+
+#ifdef __AVX2__
+/**
+ * Low 32 bits of each lane of a times the same of b, as full 64-bit lanes.
+ */
+static inline v4du mul32(v4du a, v4du b) {
+  return (v4du) _mm256_mul_epu32((__m256i) a, (__m256i) b);
+}
+#endif
+
+typedef struct departure_board {
+  int n;
+  uint64_t *ids;
+  uint64_t *magic;
+} departure_board_t;
+
+void board_init(departure_board_t *board, const bus_t *buses, int n_buses) {
+  board->ids = malloc(sizeof(uint64_t) * n_buses);
+  board->magic = malloc(sizeof(uint64_t) * n_buses);
+  board->n = 0;
+
+  for (int i = 0; i < n_buses; ++i) {
+    if (buses[i].id != -1) {
+      board->ids[board->n] = buses[i].id;
+      board->magic[board->n] = UINT64_MAX / buses[i].id + 1;
+      board->n++;
+    }
+  }
+}
+
+void board_free(departure_board_t *board) {
+  free(board->ids);
+  free(board->magic);
+}
+
+/**
+ * For each query time, the first bus (in list order) with the shortest wait,
+ * and that wait. Same answer as find_bus, wait = best_time - t.
+ */
+void board_query(const departure_board_t *board,
+                 const uint32_t *times,
+                 int n_queries,
+                 int *best_ids,
+                 uint32_t *waits) {
+#ifndef __AVX2__
+  const v4du low = { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff };
+#endif
+  int q = 0;
+
+  for (; q < n_queries; q += 4) {
+    v4du t = { 0, 0, 0, 0 };
+    int lanes = (n_queries - q < 4) ? n_queries - q : 4;
+    for (int l = 0; l < lanes; ++l) {
+      t[l] = times[q + l];
+    }
+
+    v4du best_wait = { UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX };
+    v4du best_id = { 0, 0, 0, 0 };
+
+    for (int b = 0; b < board->n; ++b) {
+      uint64_t id = board->ids[b];
+      v4du d = { id, id, id, id };
+#ifdef __AVX2__
+      uint64_t magic = board->magic[b];
+      v4du magic_lo = { magic, magic, magic, magic };
+
+      // magic * t, mod 2^64, with t under 2^32.
+      v4du lowbits = mul32(magic_lo, t) + (mul32(magic_lo >> 32, t) << 32);
+
+      // High 64 bits of lowbits * d, from 32-bit halves. That's t mod d.
+      v4du r = (mul32(lowbits >> 32, d) + (mul32(lowbits, d) >> 32)) >> 32;
+#else
+      v4du lowbits = board->magic[b] * t;
+
+      // High 64 bits of lowbits * d, from 32-bit halves. That's t mod d.
+      v4du r = ((lowbits >> 32) * d + (((lowbits & low) * d) >> 32)) >> 32;
+#endif
+      v4du wait = (d - r) & (r != 0);
+
+      v4du better = wait < best_wait;
+      best_wait = (better & wait) | (~better & best_wait);
+      best_id = (better & d) | (~better & best_id);
+    }
+
+    for (int l = 0; l < lanes; ++l) {
+      best_ids[q + l] = (int) best_id[l];
+      waits[q + l] = (uint32_t) best_wait[l];
+    }
+  }
+}
+
+/*
+ * Every departure, in order, from some time on: a min-heap holding each
+ * bus's next departure. Taking one is O(log b); seeking just recomputes each
+ * bus's next departure, so no earlier events are ever generated.
+ */
+typedef struct departure {
+  long time;
+  int id;
+  int index;    // Position in the bus list; breaks ties.
+} departure_t;
+
+typedef struct departure_stream {
+  departure_t *heap;
+  int n;
+} departure_stream_t;
+
+static bool departs_before(departure_t *a, departure_t *b) {
+  return a->time < b->time || (a->time == b->time && a->index < b->index);
+}
+
+static void stream_sift_down(departure_stream_t *stream, int i) {
+  for (;;) {
+    int least = i;
+    int l = 2 * i + 1;
+    int r = l + 1;
+    if (l < stream->n && departs_before(&stream->heap[l], &stream->heap[least])) {
+      least = l;
+    }
+    if (r < stream->n && departs_before(&stream->heap[r], &stream->heap[least])) {
+      least = r;
+    }
+    if (least == i) {
+      return;
+    }
+    departure_t temp = stream->heap[i];
+    stream->heap[i] = stream->heap[least];
+    stream->heap[least] = temp;
+    i = least;
+  }
+}
+
+/**
+ * Fast-forward: the next departure taken will be the first at or after start.
+ */
+void stream_seek(departure_stream_t *stream, long start) {
+  for (int i = 0; i < stream->n; ++i) {
+    departure_t *d = &stream->heap[i];
+    d->time = (start / d->id) * d->id;
+    if (d->time < start) {
+      d->time += d->id;
+    }
+  }
+  for (int i = stream->n / 2 - 1; i >= 0; --i) {
+    stream_sift_down(stream, i);
+  }
+}
+
+void stream_init(departure_stream_t *stream,
+                 const bus_t *buses,
+                 int n_buses,
+                 long start) {
+  stream->heap = malloc(sizeof(departure_t) * n_buses);
+  stream->n = 0;
+
+  for (int i = 0; i < n_buses; ++i) {
+    if (buses[i].id != -1) {
+      stream->heap[stream->n].id = buses[i].id;
+      stream->heap[stream->n].index = i;
+      stream->n++;
+    }
+  }
+
+  stream_seek(stream, start);
+}
+
+/**
+ * Take the next departure, and queue up that bus's one after.
+ *
+ * Return false if there are no buses, so nothing ever departs.
+ */
+bool stream_next(departure_stream_t *stream, departure_t *next) {
+  if (stream->n == 0) {
+    return false;
+  }
+  *next = stream->heap[0];
+  stream->heap[0].time += stream->heap[0].id;
+  stream_sift_down(stream, 0);
+  return true;
+}
+
+void stream_free(departure_stream_t *stream) {
+  free(stream->heap);
+  stream->heap = NULL;
+  stream->n = 0;
+}
+
+/*
+ * Schedule files, in the puzzle's format: an optional first line with the
+ * earliest departure time, then the comma-separated bus list.
+ *
+ * The file is read once, a chunk at a time, straight into a growable array
+ * of just the real buses, with each bus's list position kept alongside in
+ * offsets. Nothing is counted up front, so lists of any length are fine.
+ */
+typedef struct schedule {
+  long earliest_departure_time;   // -1 if the file doesn't have one.
+  bus_t *buses;                   // No x entries.
+  int *offsets;                   // List position of each bus.
+  int n_buses;
+  int n_slots;                    // List length, x entries included.
+  int capacity;
+} schedule_t;
+
+static void schedule_push(schedule_t *schedule, int id, int offset) {
+  if (schedule->n_buses == schedule->capacity) {
+    schedule->capacity = schedule->capacity ? schedule->capacity * 2 : 64;
+    schedule->buses = realloc(schedule->buses, sizeof(bus_t) * schedule->capacity);
+    schedule->offsets = realloc(schedule->offsets, sizeof(int) * schedule->capacity);
+  }
+  schedule->buses[schedule->n_buses].id = id;
+  schedule->buses[schedule->n_buses].best_time = LONG_MAX;
+  schedule->offsets[schedule->n_buses] = offset;
+  schedule->n_buses++;
+}
+
+void schedule_free(schedule_t *schedule) {
+  free(schedule->buses);
+  free(schedule->offsets);
+  memset(schedule, 0, sizeof(schedule_t));
+}
+
+/**
+ * Return false, with a message, if the file is missing or malformed.
+ */
+bool load_schedule(const char* filename, schedule_t *schedule) {
+  memset(schedule, 0, sizeof(schedule_t));
+  schedule->earliest_departure_time = -1;
+
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    aoc_perror("fopen");
+    return false;
+  }
+
+  char chunk[65536];
+  size_t n;
+  long acc = 0;
+  bool digits = false;
+  bool x = false;
+  bool comma_on_line = false;
+  bool list_done = false;
+  int line = 1;
+  bool ok = true;
+
+  do {
+    n = fread(chunk, 1, sizeof(chunk), fp);
+
+    // A zero-length read is end of file; treat it as one last newline.
+    for (size_t i = 0; (i < n || (n == 0 && i == 0)) && ok; ++i) {
+      char c = (n == 0) ? '\n' : chunk[i];
+
+      if (c >= '0' && c <= '9') {
+        if (x || list_done || acc > (LONG_MAX - 9) / 10) {
+          ok = false;
+        }
+        acc = acc * 10 + (c - '0');
+        digits = true;
+      } else if (c == 'x') {
+        if (digits || x || list_done) {
+          ok = false;
+        }
+        x = true;
+      } else if (c == ',' || c == '\n') {
+        if (c == ',' && !digits && !x) {
+          ok = false;   // Empty entry.
+        }
+        if (digits && acc == 0) {
+          ok = false;   // Bus 0 would never leave.
+        }
+        // Bus ids are ints; only a departure time may be bigger.
+        bool departure = (c == '\n' && line == 1 && !comma_on_line);
+        if (digits && acc > INT_MAX && !departure) {
+          ok = false;
+        }
+
+        if (digits) {
+          schedule_push(schedule, (int) acc, schedule->n_slots++);
+        } else if (x) {
+          schedule->n_slots++;
+        }
+
+        if (c == ',') {
+          comma_on_line = true;
+        } else if (schedule->n_slots > 0) {
+          // A lone number on the first line is the departure time, not a bus.
+          if (line == 1 && !comma_on_line && digits) {
+            schedule->earliest_departure_time = acc;
+            schedule->n_buses = 0;
+            schedule->n_slots = 0;
+          } else {
+            list_done = true;
+          }
+        }
+
+        if (c == '\n') {
+          line++;
+          comma_on_line = false;
+        }
+        acc = 0;
+        digits = false;
+        x = false;
+      } else if (c != '\r') {
+        ok = false;
+      }
+
+      if (!ok) {
+        aoc_warn("woe! bad schedule at %s:%d: '%c'\n", filename, line, c);
+      }
+    }
+  } while (n > 0 && ok);
+
+  fclose(fp);
+
+  // Just one number in the whole file: that was a bus after all.
+  if (ok && schedule->n_slots == 0 && schedule->earliest_departure_time > INT_MAX) {
+    aoc_warn("woe! bus %ld too big in %s\n", schedule->earliest_departure_time, filename);
+    ok = false;
+  }
+  if (ok && schedule->n_slots == 0 && schedule->earliest_departure_time != -1) {
+    schedule_push(schedule, (int) schedule->earliest_departure_time, schedule->n_slots++);
+    schedule->earliest_departure_time = -1;
+  }
+
+  if (!ok) {
+    schedule_free(schedule);
+  }
+  return ok;
+}
+
+/**
+ * Load each file into its own schedule. Return how many loaded; ones that
+ * didn't are left empty.
+ */
+int load_schedules(const char **filenames, int n_files, schedule_t *schedules) {
+  int loaded = 0;
+  for (int i = 0; i < n_files; ++i) {
+    if (load_schedule(filenames[i], &schedules[i])) {
+      loaded++;
+    }
+  }
+  return loaded;
+}
+
+/*
+ * Cached subset alignments: "when do buses A, B and C next leave at these
+ * offsets?", asked over and over for overlapping subsets.
+ *
+ * Each query's (bus, offset) pairs are sorted into a canonical order and
+ * merged one at a time, and every partial merge is kept as a node in a
+ * trie hanging off the empty set. A later query that shares a prefix starts
+ * from the deepest cached node instead of from scratch. Partial merges stay
+ * in 128 bits; a subset whose moduli won't fit reports failure.
+ */
+typedef struct subset_node {
+  struct subset_node *parent;
+  int id;
+  int residue;              // Departure time mod id.
+  bool ok;                  // False if no time works, or it overflowed.
+  unsigned __int128 a;      // t = a (mod m) for everything up to here.
+  unsigned __int128 m;
+  struct subset_node *next; // Hash chain.
+} subset_node_t;
+
+typedef struct subset_cache {
+  subset_node_t root;
+  subset_node_t **buckets;
+  int n_buckets;
+  int n_nodes;
+  long hits;
+  long misses;
+} subset_cache_t;
+
+typedef struct subset_leg {
+  int id;
+  int residue;
+} subset_leg_t;
+
+static unsigned long subset_hash(subset_node_t *parent, int id, int residue) {
+  unsigned long h = (unsigned long) parent;
+  h = h * 31 + id;
+  h = h * 31 + residue;
+  return h ^ (h >> 17);
+}
+
+static int cmp_legs(const void *e1, const void *e2) {
+  const subset_leg_t *a = e1;
+  const subset_leg_t *b = e2;
+  if (a->id != b->id) return (a->id > b->id) ? 1 : -1;
+  if (a->residue != b->residue) return (a->residue > b->residue) ? 1 : -1;
+  return 0;
+}
+
+void subset_cache_init(subset_cache_t *cache) {
+  memset(cache, 0, sizeof(subset_cache_t));
+  cache->root.ok = true;
+  cache->root.m = 1;
+  cache->n_buckets = 1024;
+  cache->buckets = calloc(cache->n_buckets, sizeof(subset_node_t*));
+}
+
+static void subset_cache_grow(subset_cache_t *cache) {
+  int n_buckets = cache->n_buckets * 2;
+  subset_node_t **buckets = calloc(n_buckets, sizeof(subset_node_t*));
+
+  for (int i = 0; i < cache->n_buckets; ++i) {
+    subset_node_t *node = cache->buckets[i];
+    while (node) {
+      subset_node_t *next = node->next;
+      unsigned long h = subset_hash(node->parent, node->id, node->residue) % n_buckets;
+      node->next = buckets[h];
+      buckets[h] = node;
+      node = next;
+    }
+  }
+
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->n_buckets = n_buckets;
+}
+
+/**
+ * The node for parent plus one more bus, merged now if it isn't cached.
+ */
+static subset_node_t* subset_child(subset_cache_t *cache,
+                                   subset_node_t *parent,
+                                   int id,
+                                   int residue) {
+  unsigned long h = subset_hash(parent, id, residue);
+
+  for (subset_node_t *node = cache->buckets[h % cache->n_buckets]; node; node = node->next) {
+    if (node->parent == parent && node->id == id && node->residue == residue) {
+      cache->hits++;
+      return node;
+    }
+  }
+  cache->misses++;
+
+  subset_node_t *node = calloc(1, sizeof(subset_node_t));
+  node->parent = parent;
+  node->id = id;
+  node->residue = residue;
+  node->ok = parent->ok && parent->m < (((unsigned __int128) 1) << 95);
+
+  if (node->ok) {
+    long k;
+    long factor = crt_step((long) (parent->a % id), (long) (parent->m % id), residue, id, &k);
+    node->ok = (factor != 0);
+    node->a = parent->a + parent->m * k;
+    node->m = parent->m * factor;
+  }
+
+  node->next = cache->buckets[h % cache->n_buckets];
+  cache->buckets[h % cache->n_buckets] = node;
+  if (++cache->n_nodes > cache->n_buckets) {
+    subset_cache_grow(cache);
+  }
+  return node;
+}
+
+/**
+ * Earliest t where each bus i leaves at t + offsets[i]. Return false if
+ * there isn't one (or it's too big for 128 bits).
+ */
+bool subset_cache_query(subset_cache_t *cache,
+                        const bus_t *buses,
+                        const int *offsets,
+                        int n_buses,
+                        unsigned __int128 *t) {
+  subset_leg_t *legs = malloc(sizeof(subset_leg_t) * (n_buses ? n_buses : 1));
+  int n_legs = 0;
+
+  for (int i = 0; i < n_buses; ++i) {
+    int id = buses[i].id;
+    if (id != -1) {
+      legs[n_legs].id = id;
+      legs[n_legs].residue = (int) (((-(long) offsets[i]) % id + id) % id);
+      n_legs++;
+    }
+  }
+  qsort(legs, n_legs, sizeof(subset_leg_t), cmp_legs);
+
+  subset_node_t *node = &cache->root;
+  for (int i = 0; i < n_legs && node->ok; ++i) {
+    // The same bus twice is only a new constraint if it disagrees.
+    if (i > 0 && legs[i].id == legs[i - 1].id && legs[i].residue == legs[i - 1].residue) {
+      continue;
+    }
+    node = subset_child(cache, node, legs[i].id, legs[i].residue);
+  }
+
+  free(legs);
+  *t = node->a;
+  return node->ok;
+}
+
+void subset_cache_report(subset_cache_t *cache) {
+  long lookups = cache->hits + cache->misses;
+  size_t bytes = sizeof(subset_cache_t)
+               + sizeof(subset_node_t*) * cache->n_buckets
+               + sizeof(subset_node_t) * cache->n_nodes;
+  printf("subset cache: %d nodes, %zu bytes, %ld/%ld merges cached (%.1f%% hit rate)\n",
+         cache->n_nodes, bytes, cache->hits, lookups,
+         lookups ? 100.0 * cache->hits / lookups : 0.0);
+}
+
+void subset_cache_free(subset_cache_t *cache) {
+  for (int i = 0; i < cache->n_buckets; ++i) {
+    subset_node_t *node = cache->buckets[i];
+    while (node) {
+      subset_node_t *next = node->next;
+      free(node);
+      node = next;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = NULL;
+}
+
+/**
+ * Part 1 is the soonest bus's ID times the wait for it; part 2 is the
+ * earliest time the whole list lines up.
+ */
+bool day13_solve(int part, const char *path, char *answer, size_t answer_size) {
+  PROF_SCOPE("day13_solve");
+  schedule_t schedule;
+  if (!load_schedule(path, &schedule)) {
+    return false;
+  }
+
+  bool ok;
+  if (part == 1) {
+    long earliest_departure_time = schedule.earliest_departure_time;
+    bus_t best_bus;
+    find_bus(earliest_departure_time, schedule.buses, schedule.n_buses, &best_bus);
+
+    ok = (earliest_departure_time != -1 && best_bus.id != -1);
+    if (ok) {
+      snprintf(answer, answer_size, "%ld",
+               best_bus.id * (best_bus.best_time - earliest_departure_time));
+    }
+  } else {
+    crt_stats_t stats;
+    ok = earliest_alignment_at(schedule.buses, schedule.offsets, schedule.n_buses,
+                               answer, answer_size, &stats);
+  }
+
+  schedule_free(&schedule);
+  return ok;
+}
+
+#ifndef AOC_LIBRARY
+
 void test() {
+  arena_t arena;
+  arena_init(&arena, 0);
+
   long earliest_departure_time = 939;
   char *bus_input = "7,13,x,x,59,x,31,19";
   int n_buses = count_buses(bus_input);
-  bus_t *buses = malloc(sizeof(bus_t) * n_buses);
+  bus_t *buses = arena_alloc(&arena, sizeof(bus_t) * n_buses);
   assert(n_buses == 8);
 
   parse_bus_list(bus_input, buses);
   for (int i = 0; i < n_buses; ++i) {
     printf("buses[%d] = %d\n", i, buses[i].id);
   }
-  bus_t *best_bus = malloc(sizeof(bus_t));
+  bus_t *best_bus = arena_alloc(&arena, sizeof(bus_t));
   find_bus(earliest_departure_time, buses, n_buses, best_bus);
 
   printf("Best time: bus %d, time=%ld\n", best_bus->id, best_bus->best_time);
@@ -106,30 +1017,452 @@ void test() {
   assert(best_bus->best_time == 944);
 
   printf("wait x bus id = %ld\n", best_bus->id * (best_bus->best_time - earliest_departure_time));
+
+  arena_free(&arena);
 }
 
 void part1() {
-  long earliest_departure_time = 1009310L;
-  char* bus_input = "19,x,x,x,x,x,x,x,x,x,x,x,x,37,x,x,x,x,x,599,x,29,x,x,x,x,x,x,x,x,x,x,x,x,x,x,17,x,x,x,x,x,23,x,x,x,x,x,x,x,761,x,x,x,x,x,x,x,x,x,41,x,x,13";
+  schedule_t schedule;
+  if (!load_schedule("day13_data.txt", &schedule)) {
+    printf("woe! can't load day13_data.txt\n");
+    return;
+  }
+  long earliest_departure_time = schedule.earliest_departure_time;
+
+  for (int i = 0; i < schedule.n_buses; ++i) {
+    printf("buses[%d] = %d\n", schedule.offsets[i], schedule.buses[i].id);
+  }
+  bus_t best_bus;
+  find_bus(earliest_departure_time, schedule.buses, schedule.n_buses, &best_bus);
+
+  printf("Best time: bus %d, time=%ld\n", best_bus.id, best_bus.best_time);
+  printf("wait x bus id = %ld\n", best_bus.id * (best_bus.best_time - earliest_departure_time));
 
+  schedule_free(&schedule);
+}
+
+static void check_alignment(const char *bus_input, const char *expected) {
   int n_buses = count_buses(bus_input);
   bus_t *buses = malloc(sizeof(bus_t) * n_buses);
-
   parse_bus_list(bus_input, buses);
+
+  char out[64];
+  crt_stats_t stats;
+  bool ok = earliest_alignment(buses, n_buses, out, sizeof(out), &stats);
+
+  if (expected) {
+    assert(ok);
+    assert(strcmp(out, expected) == 0);
+
+    // One timed merge per listed bus.
+    int listed = 0;
+    for (int i = 0; i < n_buses; ++i) {
+      listed += (buses[i].id != -1);
+    }
+    assert(crt_merges(&stats) == listed);
+    assert(stats.steps_128 + stats.steps_big == listed);
+  } else {
+    assert(!ok);
+  }
+  free(buses);
+}
+
+void test_alignment() {
+  check_alignment("7,13,x,x,59,x,31,19", "1068781");
+  check_alignment("17,x,13,19", "3417");
+  check_alignment("67,7,59,61", "754018");
+  check_alignment("67,x,7,59,61", "779210");
+  check_alignment("67,7,x,59,61", "1261476");
+  check_alignment("1789,37,47,1889", "1202161486");
+
+  // Not coprime, but consistent: t = 4.
+  check_alignment("4,x,6", "4");
+  // Not coprime, and t can't be both even and odd.
+  check_alignment("4,6", NULL);
+
+  // Hundreds of buses: the first 300 primes, one minute apart.
+  int n_buses = 300;
+  bus_t *buses = malloc(sizeof(bus_t) * n_buses);
+  int n = 0;
+  for (int p = 2; n < n_buses; ++p) {
+    bool prime = true;
+    for (int d = 2; d * d <= p && prime; ++d) {
+      prime = (p % d != 0);
+    }
+    if (prime) {
+      buses[n++].id = p;
+    }
+  }
+
+  char out[4096];
+  crt_stats_t stats;
+  bool aligned = earliest_alignment(buses, n_buses, out, sizeof(out), &stats);
+  assert(aligned);
+  assert(stats.steps_big > 0);
+  assert(crt_merges(&stats) == n_buses);
+
+  // The bignum takes over once the modulus passes 95 bits.
+  int wide = 0;
+  for (int b = 95 / CRT_BUCKET_BITS; b < CRT_BUCKETS; ++b) {
+    wide += stats.by_width[b].merges;
+  }
+  assert(wide >= stats.steps_big);
+
+  // Check every congruence against the decimal answer.
   for (int i = 0; i < n_buses; ++i) {
-    printf("buses[%d] = %d\n", i, buses[i].id);
+    long r = 0;
+    for (char *c = out; *c; ++c) {
+      r = (r * 10 + (*c - '0')) % buses[i].id;
+    }
+    assert((r + i) % buses[i].id == 0);
   }
-  bus_t *best_bus = malloc(sizeof(bus_t));
-  find_bus(earliest_departure_time, buses, n_buses, best_bus);
+  printf("300 primes align at a %zu-digit time\n", strlen(out));
+  print_crt_stats(&stats);
 
-  printf("Best time: bus %d, time=%ld\n", best_bus->id, best_bus->best_time);
-  printf("wait x bus id = %ld\n", best_bus->id * (best_bus->best_time - earliest_departure_time));
+  free(buses);
 }
 
+void part2() {
+  schedule_t schedule;
+  if (!load_schedule("day13_data.txt", &schedule)) {
+    printf("woe! can't load day13_data.txt\n");
+    return;
+  }
+
+  char out[64];
+  crt_stats_t stats;
+  if (earliest_alignment_at(schedule.buses, schedule.offsets, schedule.n_buses,
+                            out, sizeof(out), &stats)) {
+    printf("Earliest aligned departure: %s\n", out);
+  } else {
+    printf("woe! the buses never line up\n");
+  }
+  print_crt_stats(&stats);
+
+  schedule_free(&schedule);
+}
+
+void test_board() {
+  char* bus_input = "19,x,x,x,x,x,x,x,x,x,x,x,x,37,x,x,x,x,x,599,x,29,x,x,x,x,x,x,x,x,x,x,x,x,x,x,17,x,x,x,x,x,23,x,x,x,x,x,x,x,761,x,x,x,x,x,x,x,x,x,41,x,x,13";
+  int n_buses = count_buses(bus_input);
+  bus_t *buses = malloc(sizeof(bus_t) * n_buses);
+  parse_bus_list(bus_input, buses);
+
+  departure_board_t board;
+  board_init(&board, buses, n_buses);
+
+  int n_queries = 1000003;
+  uint32_t *times = malloc(sizeof(uint32_t) * n_queries);
+  int *best_ids = malloc(sizeof(int) * n_queries);
+  uint32_t *waits = malloc(sizeof(uint32_t) * n_queries);
+
+  uint32_t seed = 13;
+  for (int i = 0; i < n_queries; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    times[i] = (i < 100) ? (uint32_t) i : seed;
+  }
+  times[100] = 1009310;
+  times[101] = UINT32_MAX;
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  board_query(&board, times, n_queries, best_ids, waits);
+  double board_secs = seconds_since(&start);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bus_t best_bus;
+  long check = 0;
+  for (int i = 0; i < n_queries; ++i) {
+    find_bus(times[i], buses, n_buses, &best_bus);
+    check += best_bus.id;
+  }
+  double find_bus_secs = seconds_since(&start);
+
+  for (int i = 0; i < n_queries; ++i) {
+    find_bus(times[i], buses, n_buses, &best_bus);
+    assert(best_ids[i] == best_bus.id);
+    assert(waits[i] == best_bus.best_time - times[i]);
+    check -= best_ids[i];
+  }
+  assert(check == 0);
+
+  assert(best_ids[100] == 599 && waits[100] == 5);
+  printf("%d queries: board %.1f ns/query, find_bus %.1f ns/query\n",
+         n_queries, board_secs * 1e9 / n_queries, find_bus_secs * 1e9 / n_queries);
+
+  board_free(&board);
+  free(times);
+  free(best_ids);
+  free(waits);
+  free(buses);
+}
+
+void test_stream() {
+  char *bus_input = "7,13,x,x,59,x,31,19";
+  int n_buses = count_buses(bus_input);
+  bus_t *buses = malloc(sizeof(bus_t) * n_buses);
+  parse_bus_list(bus_input, buses);
+
+  departure_stream_t stream;
+  stream_init(&stream, buses, n_buses, 939);
+
+  departure_t first;
+  bool departed = stream_next(&stream, &first);
+  assert(departed && first.id == 59 && first.time == 944);
+
+  // Compare with checking every bus at every minute.
+  long time = 944;
+  int index = 4;
+  for (int n = 0; n < 1000; ++n) {
+    departure_t d;
+    departed = stream_next(&stream, &d);
+    assert(departed);
+
+    // Advance the brute-force cursor to the next (time, index) departure.
+    do {
+      if (++index == n_buses) {
+        index = 0;
+        time++;
+      }
+    } while (buses[index].id == -1 || time % buses[index].id != 0);
+
+    assert(d.time == time && d.id == buses[index].id);
+  }
+
+  // Way off into the future, without going through everything in between.
+  stream_seek(&stream, 1000000000000L);
+  departure_t later;
+  departed = stream_next(&stream, &later);
+  bus_t best_bus;
+  find_bus(1000000000000L, buses, n_buses, &best_bus);
+  assert(departed && later.id == best_bus.id && later.time == best_bus.best_time);
+
+  // All x: nothing ever leaves.
+  bus_t none[3] = { { -1, 0 }, { -1, 0 }, { -1, 0 } };
+  departure_stream_t empty;
+  stream_init(&empty, none, 3, 939);
+  departed = stream_next(&empty, &later);
+  assert(!departed);
+  stream_free(&empty);
+  printf("yay! departures stream in order.\n");
+
+  stream_free(&stream);
+  free(buses);
+}
+
+static void write_file(const char *path, const char *contents) {
+  FILE *fp = fopen(path, "w");
+  assert(fp);
+  fputs(contents, fp);
+  fclose(fp);
+}
+
+void test_load_schedule() {
+  const char *filenames[] = { "day13_test_data.txt", "day13_data.txt" };
+  schedule_t schedules[2];
+  int loaded = load_schedules(filenames, 2, schedules);
+  assert(loaded == 2);
+
+  assert(schedules[0].earliest_departure_time == 939);
+  assert(schedules[0].n_buses == 5);
+  assert(schedules[0].n_slots == 8);
+  assert(schedules[0].buses[2].id == 59 && schedules[0].offsets[2] == 4);
+
+  char out[64];
+  crt_stats_t stats;
+  bool aligned = earliest_alignment_at(schedules[0].buses, schedules[0].offsets,
+                                       schedules[0].n_buses, out, sizeof(out), &stats);
+  assert(aligned);
+  assert(strcmp(out, "1068781") == 0);
+
+  // Seven digits don't fit in seven bytes.
+  aligned = earliest_alignment_at(schedules[0].buses, schedules[0].offsets,
+                                  schedules[0].n_buses, out, 7, &stats);
+  assert(!aligned);
+  aligned = earliest_alignment_at(schedules[0].buses, schedules[0].offsets,
+                                  schedules[0].n_buses, out, 8, &stats);
+  assert(aligned && strcmp(out, "1068781") == 0);
+
+  assert(schedules[1].earliest_departure_time == 1009310);
+  assert(schedules[1].n_buses == 9);
+  schedule_free(&schedules[0]);
+  schedule_free(&schedules[1]);
+
+  // No departure time, no trailing newline.
+  char path[] = "/tmp/day13_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  write_file(path, "17,x,13,19");
+  schedule_t schedule;
+  bool ok = load_schedule(path, &schedule);
+  assert(ok);
+  assert(schedule.earliest_departure_time == -1 && schedule.n_buses == 3);
+  assert(schedule.offsets[2] == 3);
+  schedule_free(&schedule);
+
+  // A complaint, not an exit.
+  write_file(path, "939\n7,13,y\n");
+  ok = load_schedule(path, &schedule);
+  assert(!ok);
+
+  // Bus ids past INT_MAX are refused; a departure time that big is fine.
+  write_file(path, "939\n7,4294967311\n");
+  ok = load_schedule(path, &schedule);
+  assert(!ok);
+  write_file(path, "4294967311\n7,13\n");
+  ok = load_schedule(path, &schedule);
+  assert(ok && schedule.earliest_departure_time == 4294967311L);
+  schedule_free(&schedule);
+
+  // A million slots, in one pass.
+  FILE *fp = fopen(path, "w");
+  assert(fp);
+  fprintf(fp, "100\n");
+  for (int i = 0; i < 1000000; ++i) {
+    if (i % 3 == 0) {
+      fprintf(fp, "%d,", 7 + i % 1000);
+    } else {
+      fprintf(fp, "x,");
+    }
+  }
+  fprintf(fp, "13\n");
+  fclose(fp);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ok = load_schedule(path, &schedule);
+  double secs = seconds_since(&start);
+  assert(ok);
+
+  assert(schedule.n_slots == 1000001);
+  assert(schedule.n_buses == 333335);
+  assert(schedule.buses[1].id == 10 && schedule.offsets[1] == 3);
+  printf("loaded %d slots in %.3fs\n", schedule.n_slots, secs);
+  schedule_free(&schedule);
+  remove(path);
+}
+
+void test_subset_cache() {
+  schedule_t schedule;
+  bool ok = load_schedule("day13_data.txt", &schedule);
+  assert(ok);
+  int n = schedule.n_buses;
+
+  subset_cache_t cache;
+  subset_cache_init(&cache);
+
+  bus_t *buses = malloc(sizeof(bus_t) * n);
+  int *offsets = malloc(sizeof(int) * n);
+
+  // Every subset of the nine buses, twice over, checked against the solver.
+  for (int round = 0; round < 2; ++round) {
+    for (int mask = 1; mask < (1 << n); ++mask) {
+      int k = 0;
+      for (int i = 0; i < n; ++i) {
+        if (mask & (1 << i)) {
+          buses[k] = schedule.buses[i];
+          offsets[k] = schedule.offsets[i];
+          k++;
+        }
+      }
+
+      unsigned __int128 t;
+      ok = subset_cache_query(&cache, buses, offsets, k, &t);
+      assert(ok);
+
+      char expected[64], actual[64];
+      crt_stats_t stats;
+      ok = earliest_alignment_at(buses, offsets, k, expected, sizeof(expected), &stats);
+      assert(ok);
+
+      bignum_t big;
+      big_init(&big, t);
+      big_to_decimal(&big, actual, sizeof(actual));
+      free(big.limbs);
+      assert(strcmp(expected, actual) == 0);
+    }
+  }
+
+  // Buses that can't agree.
+  bus_t clash[2] = { { 4, 0 }, { 6, 0 } };
+  int clash_offsets[2] = { 0, 1 };
+  unsigned __int128 t;
+  ok = subset_cache_query(&cache, clash, clash_offsets, 2, &t);
+  assert(!ok);
+
+  subset_cache_report(&cache);
+  assert(cache.hits > cache.misses);
+
+  subset_cache_free(&cache);
+  free(buses);
+  free(offsets);
+  schedule_free(&schedule);
+}
+
+/*
+ * Benchmarks: one find_bus over a long list of random buses, half of them x.
+ */
+typedef struct bus_bench {
+  bus_t *buses;
+  int size;
+  long time;
+} bus_bench_t;
+
+void* setup_buses(long size, uint64_t seed) {
+  bus_bench_t *bench = malloc(sizeof(bus_bench_t));
+  bench->buses = malloc(sizeof(bus_t) * size);
+  bench->size = (int) size;
+  bench->time = 1000000 + bench_random(&seed) % 1000000;
+
+  for (long i = 0; i < size; ++i) {
+    bench->buses[i].id = (bench_random(&seed) % 2) ? (int) (7 + bench_random(&seed) % 1000) : -1;
+  }
+  return bench;
+}
+
+void run_buses(void *state) {
+  bus_bench_t *bench = state;
+  bus_t best_bus;
+  find_bus(bench->time, bench->buses, bench->size, &best_bus);
+
+  volatile long best_time = best_bus.best_time;
+  (void) best_time;
+}
+
+void teardown_buses(void *state) {
+  bus_bench_t *bench = state;
+  free(bench->buses);
+  free(bench);
+}
+
+// Sixteen bytes a bus: 10^8 is 1.6 GB, 10^9 would be 16 GB.
+const bench_kernel_t kernels[] = {
+  { "day13", "find_bus", 8, setup_buses, run_buses, teardown_buses, NULL },
+};
+
 int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    return bench_main(argc, argv, kernels, sizeof(kernels) / sizeof(kernels[0]));
+  }
+
   test();
 
   part1();
 
+  test_alignment();
+
+  part2();
+
+  test_board();
+
+  test_stream();
+
+  test_load_schedule();
+
+  test_subset_cache();
+
   return 0;
 }
+
+#endif
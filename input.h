@@ -0,0 +1,246 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+/*
+ * Shared input layer for the C days.
+ *
+ * The file is memory-mapped and parsed in place, so loaders don't need a
+ * getc loop or a buffer of their own. On top of the raw bytes there are three
+ * views: a stream of unsigned integers (parsed eight digits at a time, SWAR
+ * style), a grid of fixed-width lines, and a stream of letter+number opcodes.
+ *
+ * Everything is static inline so each day still builds on its own:
+ *
+ *   gcc -O2 day09.c
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "aoc.h"
+
+typedef struct input {
+  int fd;
+  const char *data;
+  size_t size;
+  struct timespec opened;
+} input_t;
+
+static inline bool input_open(const char *filename, input_t *input) {
+  memset(input, 0, sizeof(input_t));
+  clock_gettime(CLOCK_MONOTONIC, &input->opened);
+
+  input->fd = open(filename, O_RDONLY);
+  if (input->fd < 0) {
+    aoc_perror("open");
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(input->fd, &st) < 0) {
+    aoc_perror("fstat");
+    close(input->fd);
+    return false;
+  }
+
+  input->size = st.st_size;
+  if (input->size == 0) {
+    return true;
+  }
+
+  void *data = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+  if (data == MAP_FAILED) {
+    aoc_perror("mmap");
+    close(input->fd);
+    return false;
+  }
+  madvise(data, input->size, MADV_SEQUENTIAL);
+
+  input->data = data;
+  return true;
+}
+
+static inline void input_close(input_t *input) {
+  if (input->data) {
+    munmap((void*) input->data, input->size);
+  }
+  close(input->fd);
+  input->data = NULL;
+}
+
+/**
+ * Print how fast the input went from open to now. Library builds run side
+ * by side and keep quiet.
+ */
+static inline void input_report(input_t *input, const char *label) {
+#ifdef AOC_LIBRARY
+  (void) input;
+  (void) label;
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double secs = (now.tv_sec - input->opened.tv_sec)
+              + (now.tv_nsec - input->opened.tv_nsec) / 1e9;
+  printf("%s: %zu bytes in %.1f us (%.1f MB/s)\n",
+         label, input->size, secs * 1e6, secs > 0 ? input->size / secs / 1e6 : 0.0);
+#endif
+}
+
+/**
+ * How many of the eight bytes in chunk are digits, counting from the first.
+ */
+static inline int swar_digit_count(uint64_t chunk) {
+  const uint64_t high = 0xF0F0F0F0F0F0F0F0ULL;
+  const uint64_t zeros = 0x3030303030303030ULL;
+
+  // A byte is a digit if it's 0x3_ both before and after adding 6.
+  uint64_t bad = ((chunk & high) ^ zeros)
+               | (((chunk + 0x0606060606060606ULL) & high) ^ zeros);
+  return bad ? __builtin_ctzll(bad) / 8 : 8;
+}
+
+/**
+ * Value of the first len (1-8) digit bytes of chunk, first digit lowest.
+ */
+static inline uint64_t swar_parse(uint64_t chunk, int len) {
+  // Digits to 0-9, then shift the extra bytes off the top so they read as
+  // leading zeros.
+  uint64_t val = (chunk - 0x3030303030303030ULL) << (8 * (8 - len));
+
+  // Pairs, then fours, then all eight.
+  val = (val * 2561) >> 8;
+  val = ((val & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+  return ((val & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+}
+
+/**
+ * Parse the next unsigned integer at or after *pos, skipping anything that
+ * isn't a digit. Leaves *pos just past it.
+ *
+ * Return false when there are no more numbers.
+ */
+static inline bool input_next_number(const input_t *input, size_t *pos, long *value) {
+  const char *data = input->data;
+  size_t size = input->size;
+  size_t i = *pos;
+
+  while (i < size && (data[i] < '0' || data[i] > '9')) {
+    ++i;
+  }
+  if (i >= size) {
+    *pos = i;
+    return false;
+  }
+
+  uint64_t acc = 0;
+  for (;;) {
+    if (i + 8 <= size) {
+      uint64_t chunk;
+      memcpy(&chunk, data + i, 8);
+      int len = swar_digit_count(chunk);
+      if (len == 0) {
+        break;
+      }
+
+      static const uint64_t scale[9] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+      };
+      acc = acc * scale[len] + swar_parse(chunk, len);
+      i += len;
+      if (len < 8) {
+        break;
+      }
+    } else {
+      // The last few bytes of the file, one at a time.
+      if (i >= size || data[i] < '0' || data[i] > '9') {
+        break;
+      }
+      acc = acc * 10 + (data[i++] - '0');
+    }
+  }
+
+  *pos = i;
+  *value = (long) acc;
+  return true;
+}
+
+/**
+ * View the input as a grid of equal-length lines. Cell (r, c) is
+ * data[r * stride + c]. A missing newline on the last line is fine.
+ *
+ * Return false if the lines aren't all the same length.
+ */
+static inline bool input_grid(const input_t *input, int *rows, int *cols, int *stride) {
+  const char *nl = input->size ? memchr(input->data, '\n', input->size) : NULL;
+  int width = nl ? (int) (nl - input->data) : (int) input->size;
+  int line = width + (nl ? 1 : 0);
+
+  if (line == 0) {
+    *rows = *cols = *stride = 0;
+    return true;
+  }
+
+  size_t n_rows = (input->size + line - 1) / line;
+  for (size_t r = 1; r < n_rows; ++r) {
+    if (input->data[r * line - 1] != '\n') {
+      return false;
+    }
+  }
+  // The last row may be short only by its newline.
+  size_t last = input->size - (n_rows - 1) * line;
+  if (last != (size_t) line && last != (size_t) width) {
+    return false;
+  }
+
+  *rows = (int) n_rows;
+  *cols = width;
+  *stride = line;
+  return true;
+}
+
+/**
+ * Parse the next "X123" line at or after *pos; blank lines are skipped.
+ *
+ * Return 1 for an opcode, 0 at end of input, or -1 if the line is malformed
+ * (with *pos left at the bad byte).
+ */
+static inline int input_next_opcode(const input_t *input, size_t *pos, char *op, int *value) {
+  const char *data = input->data;
+  size_t size = input->size;
+  size_t i = *pos;
+
+  while (i < size && (data[i] == '\n' || data[i] == '\r')) {
+    ++i;
+  }
+  *pos = i;
+  if (i >= size) {
+    return 0;
+  }
+
+  char c = data[i];
+  if (c < 'A' || c > 'Z' || i + 1 >= size || data[i + 1] < '0' || data[i + 1] > '9') {
+    return -1;
+  }
+
+  long v = 0;
+  size_t next = i + 1;
+  input_next_number(input, &next, &v);
+  if (next < size && data[next] != '\n' && data[next] != '\r') {
+    *pos = next;
+    return -1;
+  }
+
+  *op = c;
+  *value = (int) v;
+  *pos = next;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef NARROW_H
+#define NARROW_H
+
+/*
+ * Narrow integer storage.
+ *
+ * Loaders read values as long, then repack them at the narrowest of 16, 32
+ * or 64 bits that holds the whole range, so a kernel gets four times the
+ * SIMD lanes and cache for a dataset of small numbers. Kernels come in
+ * one version per width, named kernel16, kernel32 and kernel64 and taking
+ * const intNN_t* first, and NARROW_DISPATCH calls the one that matches.
+ *
+ * Header-only and static inline, like input.h.
+ */
+
+#include <stdint.h>
+
+#include "arena.h"
+
+typedef struct narrow {
+  int width;      // Bits per value: 16, 32 or 64.
+  int n;
+  void *values;   // int16_t, int32_t or int64_t, by width.
+} narrow_t;
+
+/**
+ * The narrowest width that holds every value in [min, max] with
+ * headroom_bits to spare, so a kernel can add 2^headroom_bits of them
+ * without overflowing.
+ */
+static inline int narrow_width(long min, long max, int headroom_bits) {
+  for (int width = 16; width < 64; width *= 2) {
+    long limit = 1L << (width - 1 - headroom_bits);
+    if (min >= -limit && max < limit) {
+      return width;
+    }
+  }
+  return 64;
+}
+
+#define NARROW_PACK(out, in, count, bits, arena)                      \
+  do {                                                                \
+    int##bits##_t *packed = arena_alloc((arena), sizeof(int##bits##_t) * (count)); \
+    for (int i = 0; i < (count); ++i) {                               \
+      packed[i] = (int##bits##_t) (in)[i];                            \
+    }                                                                 \
+    (out)->values = packed;                                           \
+  } while (0)
+
+/**
+ * Copy n longs into the arena at the given width, which the caller has
+ * checked they fit.
+ */
+static inline void narrow_pack_longs(narrow_t *out, const long *values, int n,
+                                     int width, arena_t *arena) {
+  out->width = width;
+  out->n = n;
+  switch (width) {
+    case 16: NARROW_PACK(out, values, n, 16, arena); break;
+    case 32: NARROW_PACK(out, values, n, 32, arena); break;
+    default: out->width = 64; NARROW_PACK(out, values, n, 64, arena); break;
+  }
+}
+
+/**
+ * Copy n longs into the arena as narrow as they'll go.
+ */
+static inline void narrow_longs(narrow_t *out, const long *values, int n,
+                                int headroom_bits, arena_t *arena) {
+  long min = 0, max = 0;
+  for (int i = 0; i < n; ++i) {
+    if (values[i] < min) min = values[i];
+    if (values[i] > max) max = values[i];
+  }
+  narrow_pack_longs(out, values, n, narrow_width(min, max, headroom_bits), arena);
+}
+
+static inline long narrow_get(const narrow_t *array, int i) {
+  switch (array->width) {
+    case 16: return ((const int16_t*) array->values)[i];
+    case 32: return ((const int32_t*) array->values)[i];
+    default: return ((const int64_t*) array->values)[i];
+  }
+}
+
+/**
+ * Call kernel16, kernel32 or kernel64 on array's values, then the rest of
+ * the arguments.
+ */
+#define NARROW_DISPATCH(array, kernel, ...)                                   \
+  ((array)->width == 16 ? kernel##16((const int16_t*) (array)->values, __VA_ARGS__) \
+   : (array)->width == 32 ? kernel##32((const int32_t*) (array)->values, __VA_ARGS__) \
+   : kernel##64((const int64_t*) (array)->values, __VA_ARGS__))
+
+#endif
@@ -0,0 +1,564 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/*
+ * Overlapped chunked input for files too big to wait for.
+ *
+ * input.h maps a file and lets page faults do the reading, so a kernel sits
+ * idle every time it touches a page that isn't in yet. Here the file is read
+ * in fixed-size chunks into two buffers instead: while the caller parses and
+ * runs its kernel over one, the read into the other is already in flight.
+ *
+ * Reads go through io_uring where the kernel allows it (set up with raw
+ * syscalls, so there's nothing extra to link) and through a reader thread
+ * doing pread otherwise. Every chunk handed out ends at a newline; a
+ * partial last line is carried over to the front of the next chunk, so
+ * numbers and opcodes never straddle two chunks. Lines can be at most
+ * PIPELINE_MAX_LINE bytes.
+ *
+ *   pipeline_t pipe;
+ *   pipeline_open(&pipe, filename, 0, true);
+ *   while (pipeline_next(&pipe, &chunk)) { ... }
+ *   pipeline_close(&pipe, &stats);
+ *
+ * Header-only and static inline, like input.h. Build with -pthread.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "input.h"
+
+#define PIPELINE_MAX_LINE 4096
+#define PIPELINE_CHUNK_SIZE (1 << 20)
+
+typedef enum {
+  CHUNK_IDLE,
+  CHUNK_REQUESTED,   // Read submitted, not done.
+  CHUNK_READY,
+} chunk_state_t;
+
+typedef struct chunk_buffer {
+  char *base;        // PIPELINE_MAX_LINE of room for a carried line, then the chunk.
+  off_t offset;
+  size_t wanted;
+  size_t filled;     // 0 past the end of the file.
+  chunk_state_t state;
+} chunk_buffer_t;
+
+typedef struct pipeline_stats {
+  const char *backend;   // "io_uring" or "thread".
+  size_t bytes;
+  int chunks;
+  long wall_ns;          // Open to close.
+  long stall_ns;         // Of that, waiting for a read to finish.
+} pipeline_stats_t;
+
+typedef struct pipeline {
+  int fd;
+  size_t file_size;
+  size_t chunk_size;
+  off_t next_offset;     // Where the next read submitted starts.
+  chunk_buffer_t buffers[2];
+  int current;           // Buffer last handed out, or -1.
+  const char *carry;     // Partial line at the end of it.
+  size_t carry_len;
+  bool failed;
+
+  bool uring;
+  int ring_fd;
+  void *sq_ring;
+  void *cq_ring;
+  size_t sq_ring_size;
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool stop;
+
+  pipeline_stats_t stats;
+  long opened_ns;
+} pipeline_t;
+
+static inline long pipeline_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/**
+ * Fill buffer's chunk from the file, however many preads it takes.
+ */
+static inline void pipeline_pread(pipeline_t *pipe, chunk_buffer_t *buffer, size_t done) {
+  char *data = buffer->base + PIPELINE_MAX_LINE;
+  while (done < buffer->wanted) {
+    ssize_t n = pread(pipe->fd, data + done, buffer->wanted - done, buffer->offset + done);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      pipe->failed = (n < 0);
+      break;
+    }
+    done += n;
+  }
+  buffer->filled = done;
+}
+
+/*
+ * io_uring, by hand: one submission per chunk read, and completions reaped
+ * whenever the caller needs a buffer back.
+ */
+static inline bool pipeline_uring_setup(pipeline_t *pipe) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = (int) syscall(__NR_io_uring_setup, 4, &params);
+  if (fd < 0) {
+    return false;
+  }
+
+  pipe->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  pipe->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single = (params.features & IORING_FEAT_SINGLE_MMAP);
+  if (single) {
+    if (pipe->cq_ring_size > pipe->sq_ring_size) {
+      pipe->sq_ring_size = pipe->cq_ring_size;
+    }
+    pipe->cq_ring_size = pipe->sq_ring_size;
+  }
+
+  pipe->sq_ring = mmap(NULL, pipe->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  pipe->cq_ring = single ? pipe->sq_ring
+                         : mmap(NULL, pipe->cq_ring_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  pipe->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  pipe->sqes = mmap(NULL, pipe->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (pipe->sq_ring == MAP_FAILED || pipe->cq_ring == MAP_FAILED || pipe->sqes == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  char *sq = pipe->sq_ring;
+  char *cq = pipe->cq_ring;
+  pipe->sq_head = (unsigned*) (sq + params.sq_off.head);
+  pipe->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+  pipe->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+  pipe->sq_array = (unsigned*) (sq + params.sq_off.array);
+  pipe->cq_head = (unsigned*) (cq + params.cq_off.head);
+  pipe->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+  pipe->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+  pipe->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+  pipe->ring_fd = fd;
+  return true;
+}
+
+static inline void pipeline_uring_teardown(pipeline_t *pipe) {
+  munmap(pipe->sqes, pipe->sqes_size);
+  if (pipe->cq_ring != pipe->sq_ring) {
+    munmap(pipe->cq_ring, pipe->cq_ring_size);
+  }
+  munmap(pipe->sq_ring, pipe->sq_ring_size);
+  close(pipe->ring_fd);
+}
+
+/**
+ * Queue a read of buffer b's chunk.
+ *
+ * Return false if the kernel wouldn't take it (EAGAIN, EBUSY, ...), in
+ * which case the entry has been taken back off the ring.
+ */
+static inline bool pipeline_uring_submit(pipeline_t *pipe, int b) {
+  chunk_buffer_t *buffer = &pipe->buffers[b];
+  unsigned tail = *pipe->sq_tail;
+  unsigned index = tail & *pipe->sq_mask;
+
+  struct io_uring_sqe *sqe = &pipe->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = pipe->fd;
+  sqe->addr = (uint64_t) (uintptr_t) (buffer->base + PIPELINE_MAX_LINE);
+  sqe->len = (uint32_t) buffer->wanted;
+  sqe->off = buffer->offset;
+  sqe->user_data = b;
+
+  pipe->sq_array[index] = index;
+  __atomic_store_n(pipe->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  long submitted;
+  do {
+    submitted = syscall(__NR_io_uring_enter, pipe->ring_fd, 1, 0, 0, NULL, 0);
+  } while (submitted < 0 && errno == EINTR);
+
+  // Left on the ring, a later submit would send it along after all.
+  if (submitted != 1 && __atomic_load_n(pipe->sq_head, __ATOMIC_ACQUIRE) == tail) {
+    __atomic_store_n(pipe->sq_tail, tail, __ATOMIC_RELEASE);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Mark every finished read ready. A failed or short read (old kernels don't
+ * know IORING_OP_READ) is finished off with pread.
+ */
+static inline void pipeline_uring_reap(pipeline_t *pipe) {
+  unsigned head = *pipe->cq_head;
+  while (head != __atomic_load_n(pipe->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &pipe->cqes[head & *pipe->cq_mask];
+    chunk_buffer_t *buffer = &pipe->buffers[cqe->user_data];
+
+    size_t done = (cqe->res > 0) ? (size_t) cqe->res : 0;
+    if (done < buffer->wanted) {
+      pipeline_pread(pipe, buffer, done);
+    } else {
+      buffer->filled = done;
+    }
+    buffer->state = CHUNK_READY;
+    head++;
+  }
+  __atomic_store_n(pipe->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * The fallback: a thread that reads whichever requested chunk comes first.
+ */
+static inline void* pipeline_reader(void *arg) {
+  pipeline_t *pipe = arg;
+
+  pthread_mutex_lock(&pipe->lock);
+  while (!pipe->stop) {
+    chunk_buffer_t *next = NULL;
+    for (int b = 0; b < 2; ++b) {
+      chunk_buffer_t *buffer = &pipe->buffers[b];
+      if (buffer->state == CHUNK_REQUESTED && (!next || buffer->offset < next->offset)) {
+        next = buffer;
+      }
+    }
+    if (!next) {
+      pthread_cond_wait(&pipe->cond, &pipe->lock);
+      continue;
+    }
+
+    pthread_mutex_unlock(&pipe->lock);
+    pipeline_pread(pipe, next, 0);
+    pthread_mutex_lock(&pipe->lock);
+
+    next->state = CHUNK_READY;
+    pthread_cond_broadcast(&pipe->cond);
+  }
+  pthread_mutex_unlock(&pipe->lock);
+  return NULL;
+}
+
+/**
+ * Start reading the next chunk of the file into buffer b.
+ */
+static inline void pipeline_submit(pipeline_t *pipe, int b) {
+  chunk_buffer_t *buffer = &pipe->buffers[b];
+  size_t left = (pipe->next_offset < (off_t) pipe->file_size)
+              ? pipe->file_size - pipe->next_offset : 0;
+  size_t wanted = (left < pipe->chunk_size) ? left : pipe->chunk_size;
+
+  // The reader thread looks at every buffer, so they only change under the lock.
+  if (!pipe->uring) {
+    pthread_mutex_lock(&pipe->lock);
+  }
+  buffer->offset = pipe->next_offset;
+  buffer->wanted = wanted;
+  buffer->filled = 0;
+  buffer->state = (wanted == 0) ? CHUNK_READY : CHUNK_REQUESTED;
+  pipe->next_offset += wanted;
+
+  if (!pipe->uring) {
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+  } else if (wanted > 0 && !pipeline_uring_submit(pipe, b)) {
+    pipeline_pread(pipe, buffer, 0);
+    buffer->state = CHUNK_READY;
+  }
+}
+
+static inline void pipeline_wait(pipeline_t *pipe, int b) {
+  chunk_buffer_t *buffer = &pipe->buffers[b];
+  long start = pipeline_now_ns();
+
+  if (pipe->uring) {
+    pipeline_uring_reap(pipe);
+    while (buffer->state != CHUNK_READY) {
+      long waited = syscall(__NR_io_uring_enter, pipe->ring_fd, 0, 1,
+                            IORING_ENTER_GETEVENTS, NULL, 0);
+      if (waited < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        // The ring is broken, and its completion may yet turn up for a
+        // buffer we've reused, so give up on the file rather than guess.
+        aoc_perror("io_uring_enter");
+        pipe->failed = true;
+        buffer->filled = 0;
+        buffer->state = CHUNK_READY;
+        break;
+      }
+      pipeline_uring_reap(pipe);
+    }
+  } else {
+    pthread_mutex_lock(&pipe->lock);
+    while (buffer->state != CHUNK_READY) {
+      pthread_cond_wait(&pipe->cond, &pipe->lock);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+  }
+
+  pipe->stats.stall_ns += pipeline_now_ns() - start;
+}
+
+/**
+ * Open filename and start reading its first two chunks. A chunk_size of 0
+ * means PIPELINE_CHUNK_SIZE. With use_uring false, or if io_uring isn't
+ * allowed here, reads go through a thread.
+ *
+ * Return false if the file can't be opened.
+ */
+static inline bool pipeline_open(pipeline_t *pipe, const char *filename,
+                                 size_t chunk_size, bool use_uring) {
+  memset(pipe, 0, sizeof(pipeline_t));
+  pipe->opened_ns = pipeline_now_ns();
+  pipe->current = -1;
+  pipe->chunk_size = chunk_size ? chunk_size : PIPELINE_CHUNK_SIZE;
+
+  pipe->fd = open(filename, O_RDONLY);
+  if (pipe->fd < 0) {
+    aoc_perror("open");
+    return false;
+  }
+  struct stat st;
+  if (fstat(pipe->fd, &st) < 0) {
+    aoc_perror("fstat");
+    close(pipe->fd);
+    return false;
+  }
+  pipe->file_size = st.st_size;
+  posix_fadvise(pipe->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  for (int b = 0; b < 2; ++b) {
+    pipe->buffers[b].base = malloc(PIPELINE_MAX_LINE + pipe->chunk_size);
+    pipe->buffers[b].state = CHUNK_IDLE;
+  }
+
+  pipe->uring = use_uring && pipeline_uring_setup(pipe);
+  pipe->stats.backend = pipe->uring ? "io_uring" : "thread";
+  if (!pipe->uring) {
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->cond, NULL);
+    pthread_create(&pipe->thread, NULL, pipeline_reader, pipe);
+  }
+
+  pipeline_submit(pipe, 0);
+  pipeline_submit(pipe, 1);
+  return true;
+}
+
+/**
+ * Hand back the last chunk and get the next one, which ends at a newline
+ * (or the end of the file). The chunk is good until the next call.
+ *
+ * Return false at the end of the file, or if a read failed or a line was
+ * too long (pipe->failed).
+ */
+static inline bool pipeline_next(pipeline_t *pipe, input_t *chunk) {
+  char *data;
+  size_t size;
+
+  // A chunk without a newline in it all goes to the carry, so go round
+  // again for the next.
+  do {
+    int b = (pipe->current == -1) ? 0 : 1 - pipe->current;
+    chunk_buffer_t *buffer = &pipe->buffers[b];
+    pipeline_wait(pipe, b);
+
+    if (pipe->failed || (buffer->filled == 0 && pipe->carry_len == 0)) {
+      return false;
+    }
+
+    // The line we cut off last time goes just in front of this chunk. Then
+    // the buffer it came from is free for the chunk after this one.
+    data = buffer->base + PIPELINE_MAX_LINE - pipe->carry_len;
+    if (pipe->carry_len > 0) {
+      memmove(data, pipe->carry, pipe->carry_len);
+    }
+    size = pipe->carry_len + buffer->filled;
+    if (pipe->current != -1) {
+      pipeline_submit(pipe, pipe->current);
+    }
+    pipe->current = b;
+
+    pipe->carry = NULL;
+    pipe->carry_len = 0;
+    if (buffer->filled > 0) {
+      const char *end = data + size;
+      const char *nl = end;
+      while (nl > data && nl[-1] != '\n') {
+        --nl;
+      }
+      if (end - nl > PIPELINE_MAX_LINE) {
+        fprintf(stderr, "pipeline: line longer than %d bytes\n", PIPELINE_MAX_LINE);
+        pipe->failed = true;
+        return false;
+      }
+      pipe->carry = nl;
+      pipe->carry_len = end - nl;
+      size = nl - data;
+    }
+  } while (size == 0);
+
+  memset(chunk, 0, sizeof(input_t));
+  chunk->fd = -1;
+  chunk->data = data;
+  chunk->size = size;
+  pipe->stats.bytes += size;
+  pipe->stats.chunks++;
+  return true;
+}
+
+/**
+ * Stop reading and free everything. stats may be NULL.
+ */
+static inline void pipeline_close(pipeline_t *pipe, pipeline_stats_t *stats) {
+  // Let anything still in flight land before its buffer goes away. Both
+  // buffers are always submitted, so both come back ready.
+  long stall = pipe->stats.stall_ns;
+  for (int b = 0; b < 2; ++b) {
+    pipeline_wait(pipe, b);
+  }
+  pipe->stats.stall_ns = stall;
+
+  if (pipe->uring) {
+    pipeline_uring_teardown(pipe);
+  } else {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->stop = true;
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+    pthread_join(pipe->thread, NULL);
+    pthread_mutex_destroy(&pipe->lock);
+    pthread_cond_destroy(&pipe->cond);
+  }
+
+  for (int b = 0; b < 2; ++b) {
+    free(pipe->buffers[b].base);
+  }
+  close(pipe->fd);
+
+  pipe->stats.wall_ns = pipeline_now_ns() - pipe->opened_ns;
+  if (stats) {
+    *stats = pipe->stats;
+  }
+}
+
+/*
+ * Overlap figures, for benchmarks.
+ *
+ * Reading a file cold takes read_ns on its own. Run through the pipeline,
+ * the caller only waits stall_ns of that, and spends wall_ns - stall_ns
+ * computing. Overlap is how much of the shorter of the two was hidden
+ * behind the other: 1 when the caller never waits for a read it could have
+ * overlapped, 0 when reading and computing take turns.
+ */
+
+/**
+ * Ask the kernel to drop the file's cached pages, so the next read comes
+ * from the disk. Only a hint; on tmpfs nothing is dropped.
+ */
+static inline void pipeline_drop_cache(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+}
+
+/**
+ * Time a plain cold read of the whole file, with no compute at all.
+ */
+static inline long pipeline_read_ns(const char *filename) {
+  pipeline_drop_cache(filename);
+  long start = pipeline_now_ns();
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  char *buffer = malloc(PIPELINE_CHUNK_SIZE);
+  while (read(fd, buffer, PIPELINE_CHUNK_SIZE) > 0) {
+  }
+  free(buffer);
+  close(fd);
+
+  return pipeline_now_ns() - start;
+}
+
+static inline double pipeline_overlap(long read_ns, const pipeline_stats_t *stats) {
+  long compute_ns = stats->wall_ns - stats->stall_ns;
+  long shorter = (read_ns < compute_ns) ? read_ns : compute_ns;
+  if (shorter <= 0) {
+    return 0.0;
+  }
+
+  double overlap = (double) (read_ns - stats->stall_ns) / shorter;
+  return (overlap < 0.0) ? 0.0 : (overlap > 1.0) ? 1.0 : overlap;
+}
+
+/**
+ * Add one run's stats to a running total.
+ */
+static inline void pipeline_stats_add(pipeline_stats_t *total, const pipeline_stats_t *run) {
+  total->backend = run->backend;
+  total->bytes += run->bytes;
+  total->chunks += run->chunks;
+  total->wall_ns += run->wall_ns;
+  total->stall_ns += run->stall_ns;
+}
+
+/**
+ * The overlap fields for a bench annotate hook, averaged over runs runs.
+ */
+static inline void pipeline_annotate(const char *filename, const pipeline_stats_t *total,
+                                     int runs, char *out, size_t size) {
+  if (runs == 0) {
+    return;
+  }
+  pipeline_stats_t mean = *total;
+  mean.wall_ns /= runs;
+  mean.stall_ns /= runs;
+  long read_ns = pipeline_read_ns(filename);
+
+  snprintf(out, size, ", \"backend\": \"%s\", \"bytes\": %zu, \"read_ns\": %ld, "
+           "\"compute_ns\": %ld, \"stall_ns\": %ld, \"overlap\": %.3f",
+           mean.backend, mean.bytes / runs, read_ns,
+           mean.wall_ns - mean.stall_ns, mean.stall_ns, pipeline_overlap(read_ns, &mean));
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+ * Work-stealing thread pool for batches of independent jobs.
+ *
+ * Jobs are dealt out in contiguous blocks, one per worker; a worker that runs
+ * dry steals half of the remaining block from another worker. Each worker
+ * keeps one arena, reset before every job, so after the biggest job it has
+ * seen it makes no more allocator calls.
+ *
+ * Header-only and static inline, like arena.h. Build with -pthread.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+/**
+ * Run one job, writing its results back into it. The arena is empty.
+ */
+typedef void (*pool_job_fn)(void *job, arena_t *arena);
+
+typedef struct pool_queue {
+  pthread_mutex_t lock;
+  int head;   // Next job to run.
+  int tail;   // One past the last job.
+} pool_queue_t;
+
+typedef struct pool {
+  char *jobs;
+  size_t job_size;
+  pool_job_fn run;
+  pool_queue_t *queues;
+  int n_workers;
+} pool_t;
+
+typedef struct pool_worker {
+  pool_t *pool;
+  int id;
+} pool_worker_t;
+
+/**
+ * Take the next job from our own queue, or steal half of someone else's.
+ *
+ * Return the job index, or -1 when there's nothing left anywhere.
+ */
+static inline int pool_next_job(pool_t *pool, int id) {
+  pool_queue_t *mine = &pool->queues[id];
+
+  for (;;) {
+    pthread_mutex_lock(&mine->lock);
+    if (mine->head < mine->tail) {
+      int job = mine->head++;
+      pthread_mutex_unlock(&mine->lock);
+      return job;
+    }
+    pthread_mutex_unlock(&mine->lock);
+
+    bool stole = false;
+    for (int k = 1; k < pool->n_workers && !stole; ++k) {
+      pool_queue_t *victim = &pool->queues[(id + k) % pool->n_workers];
+
+      pthread_mutex_lock(&victim->lock);
+      int remaining = victim->tail - victim->head;
+      if (remaining > 0) {
+        int take = (remaining + 1) / 2;
+        int tail = victim->tail;
+        victim->tail -= take;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&mine->lock);
+        mine->head = tail - take;
+        mine->tail = tail;
+        pthread_mutex_unlock(&mine->lock);
+        stole = true;
+      } else {
+        pthread_mutex_unlock(&victim->lock);
+      }
+    }
+
+    if (!stole) {
+      return -1;
+    }
+  }
+}
+
+static inline void* pool_worker(void *arg) {
+  pool_worker_t *worker = arg;
+  pool_t *pool = worker->pool;
+  arena_t arena;
+  arena_init(&arena, 0);
+
+  int job;
+  while ((job = pool_next_job(pool, worker->id)) != -1) {
+    arena_reset(&arena);
+    pool->run(pool->jobs + (size_t) job * pool->job_size, &arena);
+  }
+
+  arena_free(&arena);
+  return NULL;
+}
+
+/**
+ * Run every one of the n_jobs jobs, each job_size bytes, on n_threads
+ * threads, and wait for them all.
+ */
+static inline void pool_run(void *jobs, size_t job_size, int n_jobs, int n_threads,
+                            pool_job_fn run) {
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+
+  pool_t pool;
+  pool.jobs = jobs;
+  pool.job_size = job_size;
+  pool.run = run;
+  pool.n_workers = n_threads;
+  pool.queues = malloc(sizeof(pool_queue_t) * n_threads);
+
+  pool_worker_t *workers = malloc(sizeof(pool_worker_t) * n_threads);
+  pthread_t *threads = malloc(sizeof(pthread_t) * n_threads);
+
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_mutex_init(&pool.queues[i].lock, NULL);
+    pool.queues[i].head = (int) ((long) n_jobs * i / n_threads);
+    pool.queues[i].tail = (int) ((long) n_jobs * (i + 1) / n_threads);
+    workers[i].pool = &pool;
+    workers[i].id = i;
+  }
+
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_create(&threads[i], NULL, pool_worker, &workers[i]);
+  }
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  // Not before: a worker still running may be stealing from any queue.
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_mutex_destroy(&pool.queues[i].lock);
+  }
+
+  free(threads);
+  free(workers);
+  free(pool.queues);
+}
+
+#endif
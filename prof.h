@@ -0,0 +1,272 @@
+#ifndef PROF_H
+#define PROF_H
+
+/*
+ * Scoped hot-path timers, compiled in with -DAOC_PROFILE.
+ *
+ *   void advance(...) {
+ *     PROF_SCOPE("advance");
+ *     ...
+ *   }
+ *
+ * A scope reads the time stamp counter (and, where perf_event_open is
+ * allowed, the thread's cycles, cache misses and branch misses) when it's
+ * entered and again when it's left. Scopes are buffered per thread and
+ * written out at exit as one Chrome trace-event file, which chrome://tracing,
+ * Perfetto and speedscope all load as a flame graph:
+ *
+ *   gcc -O2 -pthread -DAOC_PROFILE day11.c && AOC_TRACE=day11.json ./a.out
+ *
+ * The file defaults to trace.json. Without AOC_PROFILE, PROF_SCOPE expands
+ * to nothing and none of this is compiled.
+ *
+ * Header-only and static inline, like input.h; the state is weak so every
+ * day linked into runner.c shares one trace.
+ */
+
+#ifndef AOC_PROFILE
+
+#define PROF_SCOPE(name) ((void) 0)
+
+#else
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PROF_COUNTERS 3
+#define PROF_CHUNK_EVENTS 4096
+#define PROF_MAX_EVENTS (1 << 20)   // Per thread; later scopes are dropped.
+
+typedef struct prof_event {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+  uint64_t counts[PROF_COUNTERS];   // Deltas over the scope.
+} prof_event_t;
+
+typedef struct prof_chunk {
+  struct prof_chunk *next;
+  int tid;
+  int n_events;
+  prof_event_t events[PROF_CHUNK_EVENTS];
+} prof_chunk_t;
+
+typedef struct prof_thread {
+  prof_chunk_t *chunk;   // Being filled.
+  int tid;
+  int perf_fd;           // Counter group leader; -1 if unavailable, 0 if not tried.
+  long n_events;
+} prof_thread_t;
+
+typedef struct prof_scope {
+  const char *name;
+  uint64_t start;
+  uint64_t counts[PROF_COUNTERS];
+} prof_scope_t;
+
+__attribute__((weak)) pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+__attribute__((weak)) prof_chunk_t *prof_chunks = NULL;   // Every thread's, newest first.
+__attribute__((weak)) bool prof_started = false;
+__attribute__((weak)) uint64_t prof_start_ticks;
+__attribute__((weak)) struct timespec prof_start_time;
+__attribute__((weak)) long prof_dropped;
+__attribute__((weak)) bool prof_counters = false;   // Some thread got its counters.
+__attribute__((weak)) __thread prof_thread_t prof_thread;
+
+static inline uint64_t prof_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+/**
+ * Open cycles, cache misses and branch misses for this thread as one group.
+ *
+ * Return the leader's fd, or -1 if the kernel won't let us.
+ */
+static inline int prof_open_counters(void) {
+  static const uint64_t configs[PROF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+  };
+
+  int leader = -1;
+  for (int i = 0; i < PROF_COUNTERS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      if (leader >= 0) {
+        close(leader);
+      }
+      return -1;
+    }
+    if (leader < 0) {
+      leader = fd;
+    }
+  }
+
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return leader;
+}
+
+static inline void prof_read_counters(uint64_t *counts) {
+  if (prof_thread.perf_fd > 0) {
+    uint64_t group[1 + PROF_COUNTERS];
+    if (read(prof_thread.perf_fd, group, sizeof(group)) == (ssize_t) sizeof(group)) {
+      memcpy(counts, group + 1, sizeof(uint64_t) * PROF_COUNTERS);
+      return;
+    }
+  }
+  memset(counts, 0, sizeof(uint64_t) * PROF_COUNTERS);
+}
+
+static inline void prof_write_trace(void);
+
+static inline prof_scope_t prof_begin(const char *name) {
+  if (prof_thread.perf_fd == 0) {
+    prof_thread.tid = (int) syscall(SYS_gettid);
+    prof_thread.perf_fd = prof_open_counters();
+    if (prof_thread.perf_fd > 0) {
+      prof_counters = true;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    if (!prof_started) {
+      prof_started = true;
+      prof_start_ticks = prof_ticks();
+      clock_gettime(CLOCK_MONOTONIC, &prof_start_time);
+      atexit(prof_write_trace);
+    }
+    pthread_mutex_unlock(&prof_lock);
+  }
+
+  prof_scope_t scope;
+  scope.name = name;
+  prof_read_counters(scope.counts);
+  scope.start = prof_ticks();
+  return scope;
+}
+
+static inline void prof_end(prof_scope_t *scope) {
+  uint64_t end = prof_ticks();
+  uint64_t counts[PROF_COUNTERS];
+  prof_read_counters(counts);
+
+  if (prof_thread.n_events >= PROF_MAX_EVENTS) {
+    __atomic_fetch_add(&prof_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  prof_chunk_t *chunk = prof_thread.chunk;
+  if (!chunk || chunk->n_events == PROF_CHUNK_EVENTS) {
+    chunk = malloc(sizeof(prof_chunk_t));
+    chunk->tid = prof_thread.tid;
+    chunk->n_events = 0;
+
+    pthread_mutex_lock(&prof_lock);
+    chunk->next = prof_chunks;
+    prof_chunks = chunk;
+    pthread_mutex_unlock(&prof_lock);
+    prof_thread.chunk = chunk;
+  }
+
+  prof_event_t *event = &chunk->events[chunk->n_events++];
+  event->name = scope->name;
+  event->start = scope->start;
+  event->end = end;
+  for (int i = 0; i < PROF_COUNTERS; ++i) {
+    event->counts[i] = counts[i] - scope->counts[i];
+  }
+  prof_thread.n_events++;
+}
+
+/**
+ * Write every thread's scopes as complete ("X") trace events. The tick rate
+ * is measured over the whole run, so it's good for any clock that ticks
+ * steadily.
+ */
+static inline void prof_write_trace(void) {
+  const char *filename = getenv("AOC_TRACE");
+  if (!filename) {
+    filename = "trace.json";
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t ticks = prof_ticks() - prof_start_ticks;
+  double ns = (now.tv_sec - prof_start_time.tv_sec) * 1e9
+            + (now.tv_nsec - prof_start_time.tv_nsec);
+  double us_per_tick = (ticks > 0) ? ns / 1e3 / ticks : 0.0;
+
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    perror(filename);
+    return;
+  }
+
+  bool counters = prof_counters;
+  long n_events = 0;
+  fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  for (prof_chunk_t *chunk = prof_chunks; chunk; chunk = chunk->next) {
+    for (int i = 0; i < chunk->n_events; ++i) {
+      prof_event_t *event = &chunk->events[i];
+      fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                  "\"ts\": %.3f, \"dur\": %.3f",
+              n_events++ ? ",\n" : "", event->name, (int) getpid(), chunk->tid,
+              (event->start - prof_start_ticks) * us_per_tick,
+              (event->end - event->start) * us_per_tick);
+      if (counters) {
+        fprintf(fp, ", \"args\": {\"cycles\": %lu, \"cache_misses\": %lu, \"branch_misses\": %lu}",
+                (unsigned long) event->counts[0],
+                (unsigned long) event->counts[1],
+                (unsigned long) event->counts[2]);
+      }
+      fprintf(fp, "}");
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+
+  fprintf(stderr, "prof: %ld scopes (%ld dropped) to %s, hardware counters %s\n",
+          n_events, prof_dropped, filename, counters ? "on" : "unavailable");
+}
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+
+/**
+ * Time from here to the end of the enclosing block. name must be a string
+ * literal, or at least outlive the program.
+ */
+#define PROF_SCOPE(name) \
+  prof_scope_t PROF_CONCAT(prof_scope_, __LINE__) \
+      __attribute__((cleanup(prof_end), unused)) = prof_begin(name)
+
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>  // Build with -pthread.
+#include <time.h>
+#include <unistd.h>
+
+#include "aoc.h"
+
+/*
+ * Run many puzzle solutions at once, with no self-tests.
+ *
+ *   gcc -O2 -pthread -DAOC_LIBRARY -o runner runner.c day09.c day10.c \
+ *       day11.c day12.c day13.c
+ *
+ *   ./runner [-j threads] [-f job file] [day:part:path ...]
+ *
+ * Jobs come from the command line as day:part:path (11:2:day11_data.txt), or
+ * from a job file with one "day part path" per line; # starts a comment.
+ * With no jobs at all, both parts of every day run on dayNN_data.txt.
+ *
+ * The runner only handles full-size inputs: the solvers take no puzzle
+ * parameters, so day 9 always uses the 25-number preamble and the puzzle
+ * text's 5-number example (day09_test_data.txt) fails. Build day09.c on its
+ * own to check that one.
+ *
+ * Jobs are handed out in order to a pool of threads, one core each by
+ * default. Each answer is printed with the wall time its job took, in job
+ * order, once everything is done. Add -DAOC_PROFILE to the build to trace
+ * every job's kernels as well (see prof.h).
+ */
+
+typedef struct day_solver {
+  int day;
+  aoc_solver_t solve;
+} day_solver_t;
+
+static const day_solver_t solvers[] = {
+  { 9, day09_solve },
+  { 10, day10_solve },
+  { 11, day11_solve },
+  { 12, day12_solve },
+  { 13, day13_solve },
+};
+
+static const int n_solvers = sizeof(solvers) / sizeof(solvers[0]);
+
+typedef struct puzzle_job {
+  int day;
+  int part;
+  char path[256];
+
+  // Results.
+  bool ok;
+  char answer[64];
+  double secs;
+} puzzle_job_t;
+
+typedef struct puzzle_pool {
+  pthread_mutex_t lock;
+  puzzle_job_t *jobs;
+  int n_jobs;
+  int next;   // Next job to hand out.
+} puzzle_pool_t;
+
+static double seconds_since(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static aoc_solver_t solver_for(int day) {
+  for (int i = 0; i < n_solvers; ++i) {
+    if (solvers[i].day == day) {
+      return solvers[i].solve;
+    }
+  }
+  return NULL;
+}
+
+static void run_puzzle_job(puzzle_job_t *job) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  job->answer[0] = '\0';
+  job->ok = solver_for(job->day)(job->part, job->path, job->answer, sizeof(job->answer));
+  job->secs = seconds_since(&start);
+}
+
+static void* puzzle_worker(void *arg) {
+  puzzle_pool_t *pool = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    int job = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (job >= pool->n_jobs) {
+      return NULL;
+    }
+    run_puzzle_job(&pool->jobs[job]);
+  }
+}
+
+/**
+ * Run every job on n_threads threads. Results are written back into each job.
+ */
+void run_puzzles(puzzle_job_t *jobs, int n_jobs, int n_threads) {
+  if (n_threads > n_jobs) {
+    n_threads = n_jobs;
+  }
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+
+  puzzle_pool_t pool;
+  pthread_mutex_init(&pool.lock, NULL);
+  pool.jobs = jobs;
+  pool.n_jobs = n_jobs;
+  pool.next = 0;
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * n_threads);
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_create(&threads[i], NULL, puzzle_worker, &pool);
+  }
+  for (int i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool.lock);
+  free(threads);
+}
+
+/**
+ * Fill in a job, checking that the day and part exist.
+ *
+ * Return false, with a message, if they don't.
+ */
+static bool make_job(int day, int part, const char *path, puzzle_job_t *job) {
+  if (!solver_for(day) || (part != 1 && part != 2)) {
+    printf("woe! no solver for day %d part %d\n", day, part);
+    return false;
+  }
+  if (strlen(path) >= sizeof(job->path)) {
+    printf("woe! path too long: %s\n", path);
+    return false;
+  }
+
+  memset(job, 0, sizeof(puzzle_job_t));
+  job->day = day;
+  job->part = part;
+  strcpy(job->path, path);
+  return true;
+}
+
+static void push_job(puzzle_job_t **jobs, int *n_jobs, int *capacity, puzzle_job_t *job) {
+  if (*n_jobs == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 16;
+    *jobs = realloc(*jobs, sizeof(puzzle_job_t) * *capacity);
+  }
+  (*jobs)[(*n_jobs)++] = *job;
+}
+
+/**
+ * Read "day part path" lines from a job file.
+ *
+ * Return false, with a message, if the file is missing or a line is bad.
+ */
+static bool read_job_file(const char *filename, puzzle_job_t **jobs, int *n_jobs, int *capacity) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    perror(filename);
+    return false;
+  }
+
+  char line[512];
+  int line_no = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), fp)) {
+    line_no++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+
+    int day, part;
+    char path[256];
+    int fields = sscanf(line, "%d %d %255s", &day, &part, path);
+    if (fields == EOF) {
+      continue;
+    }
+
+    puzzle_job_t job;
+    if (fields != 3) {
+      printf("woe! bad job at %s:%d\n", filename, line_no);
+      ok = false;
+    } else if ((ok = make_job(day, part, path, &job))) {
+      push_job(jobs, n_jobs, capacity, &job);
+    }
+  }
+
+  fclose(fp);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  puzzle_job_t *jobs = NULL;
+  int n_jobs = 0;
+  int capacity = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      n_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      if (!read_job_file(argv[++i], &jobs, &n_jobs, &capacity)) {
+        return 1;
+      }
+    } else {
+      int day, part, used = 0;
+      puzzle_job_t job;
+      if (sscanf(argv[i], "%d:%d:%n", &day, &part, &used) != 2 || used == 0) {
+        printf("usage: %s [-j threads] [-f job file] [day:part:path ...]\n", argv[0]);
+        return 1;
+      }
+      if (!make_job(day, part, argv[i] + used, &job)) {
+        return 1;
+      }
+      push_job(&jobs, &n_jobs, &capacity, &job);
+    }
+  }
+
+  if (n_jobs == 0) {
+    for (int i = 0; i < n_solvers; ++i) {
+      for (int part = 1; part <= 2; ++part) {
+        char path[32];
+        puzzle_job_t job;
+        snprintf(path, sizeof(path), "day%02d_data.txt", solvers[i].day);
+        make_job(solvers[i].day, part, path, &job);
+        push_job(&jobs, &n_jobs, &capacity, &job);
+      }
+    }
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  run_puzzles(jobs, n_jobs, n_threads);
+  double wall = seconds_since(&start);
+
+  int failed = 0;
+  double busy = 0;
+  for (int i = 0; i < n_jobs; ++i) {
+    puzzle_job_t *job = &jobs[i];
+    if (job->ok) {
+      printf("day%02d part %d  %-24s %-20s %9.3f ms\n",
+             job->day, job->part, job->path, job->answer, job->secs * 1e3);
+    } else {
+      printf("day%02d part %d  %-24s %-20s %9.3f ms\n",
+             job->day, job->part, job->path, "FAILED", job->secs * 1e3);
+      failed++;
+    }
+    busy += job->secs;
+  }
+  printf("%d jobs (%d failed) on %d threads: %.3f ms wall, %.3f ms of work\n",
+         n_jobs, failed, n_threads < n_jobs ? n_threads : n_jobs, wall * 1e3, busy * 1e3);
+
+  free(jobs);
+  return failed ? 1 : 0;
+}